@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rack.hpp"
+#include "InputCapture.hpp"
+
+
+// Headless benchmarks of the module process() functions. Modules are
+// constructed directly and driven frame by frame, without engine or UI.
+namespace bench {
+
+// Hardware counters of the calling thread (Linux perf events). Counters that
+// are not available (other systems, or kernel.perf_event_paranoid > 2) read -1.
+struct PerfCounters {
+
+	PerfCounters();
+	~PerfCounters();
+
+	void start();
+	void stop();
+
+	int64_t cycles() const {
+		return cycleCount;
+	}
+	int64_t cacheMisses() const {
+		return cacheMissCount;
+	}
+
+private:
+
+	int cyclesFd;
+	int cacheMissesFd;
+	int64_t cycleCount;
+	int64_t cacheMissCount;
+
+};
+
+// Scenario filter from the command line. Empty runs all scenarios.
+extern std::string filter;
+
+inline bool selected(const std::string &name) {
+	return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+// Marks a port as connected with `channels` channels, as a cable would.
+inline void connect(rack::engine::Port &port, const int channels) {
+	port.channels = channels;
+}
+
+// Prints and records a result. Returns the recorded object (nullptr without results file).
+json_t *report(const std::string &name, const int64_t frames, const double seconds, const PerfCounters &counters);
+
+// Adds a result object ({"name": ..., measurements}) to the results file.
+// Returns it (nullptr without results file).
+json_t *record(json_t *resultJ);
+
+// Peak resident memory in bytes since the last reset (-1 if unknown). Where
+// the peak can't be reset (not Linux), it is the peak of the whole process.
+void resetPeakRss();
+int64_t peakRss();
+
+// Runs `frames` frames of module->process(). `drive(frame)` sets the inputs
+// before each frame. A short warm-up is not measured.
+template <typename Drive>
+void run(const std::string &name, rack::engine::Module *module, const int64_t frames, Drive drive,
+	const float sampleRate = 48000.0f) {
+	if (!selected(name)) {
+		return;
+	}
+
+	rack::engine::Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.0f / sampleRate;
+	args.frame = 0;
+
+	for (int64_t i = 0; i < frames / 10; i++, args.frame++) {
+		drive(args.frame);
+		module->process(args);
+	}
+
+	PerfCounters counters;
+	const auto startTime = std::chrono::steady_clock::now();
+	counters.start();
+
+	for (int64_t i = 0; i < frames; i++, args.frame++) {
+		drive(args.frame);
+		module->process(args);
+	}
+
+	counters.stop();
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+	report(name, frames, elapsed.count(), counters);
+}
+
+// Runs `frames` frames of all modules on 1, 2, 4 ... hardware threads. Each thread
+// processes its share of the modules, with a barrier between frames as in the
+// Rack engine. Reports the time per module frame and the speedup over one thread
+// for each thread count: below linear scaling, instances share cache lines.
+void runThreads(const std::string &name, const std::vector<rack::engine::Module*> &modules, const int64_t frames);
+
+// runThreads() with `instances` modules, each prepared by `setUp(module)` (returns false on failure).
+template <typename M, typename SetUp>
+void runScaling(const std::string &name, const int instances, const int64_t frames, SetUp setUp) {
+	if (!selected(name)) {
+		return;
+	}
+
+	std::vector<std::unique_ptr<M>> owned;
+	std::vector<rack::engine::Module*> modules;
+	for (int i = 0; i < instances; i++) {
+		owned.emplace_back(new M);
+		if (!setUp(*owned.back())) {
+			return;
+		}
+		modules.push_back(owned.back().get());
+	}
+	runThreads(name, modules, frames);
+}
+
+// Feeds a capture to the module as fast as it runs. All output voltages are
+// hashed, so equal hashes mean bit-identical output of two builds.
+void replay(rack::engine::Module *module, InputCaptureReader &reader);
+
+// Restores the module options saved with the capture.
+void loadState(rack::engine::Module *module, const InputCaptureReader &reader);
+
+// Scenarios of each module
+void logistikerScenarios(const int64_t frames);
+void noseringScenarios(const int64_t frames);
+void radioMusicScenarios(const int64_t frames);
+void loaderScenarios();
+
+// Prints and records a check. Returns whether `error` is within `bound`.
+bool checkResult(const char *name, const double error, const double bound);
+
+// Checks the fastmath approximations and tables against libm. Returns false
+// if an error exceeds its documented bound.
+bool checkFastMath();
+
+// Loads files the scenarios don't cover (e.g. FLAC without a frame count).
+// Returns false if the samples differ from the written ones.
+bool checkLoaders();
+
+// Replays a capture of the module. Returns false if the capture is of another module.
+bool replayLogistiker(InputCaptureReader &reader);
+bool replayNosering(InputCaptureReader &reader);
+bool replayRadioMusic(InputCaptureReader &reader);
+
+} // namespace bench
@@ -0,0 +1,83 @@
+#include <cmath>
+
+#include "Bench.hpp"
+#include "Crossfade.hpp"
+#include "FastMath.hpp"
+
+
+// Bounds as documented in FastMath.hpp.
+#define EXP2_MAX_RELATIVE_ERROR 2e-7
+#define SIN_QUARTER_MAX_ERROR 2e-7
+#define POW_TABLE_MAX_RELATIVE_ERROR_PER_POWER 6e-8
+
+#define EXP2_STEPS_PER_OCTAVE 8192
+
+bool bench::checkResult(const char *name, const double error, const double bound) {
+	const bool ok = error <= bound;
+	printf("%-36s %10.3g %10.3g %6s\n", name, error, bound, ok ? "ok" : "FAIL");
+	fflush(stdout);
+
+	json_t *resultJ = json_object();
+	json_object_set_new(resultJ, "name", json_string(name));
+	json_object_set_new(resultJ, "maxError", json_real(error));
+	json_object_set_new(resultJ, "bound", json_real(bound));
+	json_object_set_new(resultJ, "ok", json_boolean(ok));
+	record(resultJ);
+	return ok;
+}
+
+bool bench::checkFastMath() {
+	using rack::simd::float_4;
+
+	printf("%-36s %10s %10s\n", "check", "max error", "bound");
+	bool ok = true;
+
+	// The whole input range of exp2, which covers the pitch and rate ranges of all modules.
+	double exp2Error = 0.0;
+	double exp2Error4 = 0.0;
+	bool identical = true;
+	for (int i = -126 * EXP2_STEPS_PER_OCTAVE; i <= 127 * EXP2_STEPS_PER_OCTAVE; i += 4) {
+		const float_4 x = rack::simd::fmin(float_4(i, i + 1, i + 2, i + 3) / EXP2_STEPS_PER_OCTAVE, 127.0f);
+		const float_4 y = fastmath::exp2(x);
+		for (int lane = 0; lane < 4; lane++) {
+			const double reference = std::exp2(static_cast<double>(x[lane]));
+			const float scalar = fastmath::exp2(x[lane]);
+			exp2Error = std::max(exp2Error, std::fabs(scalar - reference) / reference);
+			exp2Error4 = std::max(exp2Error4, std::fabs(y[lane] - reference) / reference);
+			identical = identical && (scalar == y[lane]);
+		}
+	}
+	ok &= checkResult("fastmath/exp2", exp2Error, EXP2_MAX_RELATIVE_ERROR);
+	ok &= checkResult("fastmath/exp2-float4", exp2Error4, EXP2_MAX_RELATIVE_ERROR);
+	if (!identical) {
+		printf("fastmath/exp2: scalar and float_4 results differ\n");
+		ok = false;
+	}
+
+	double sinError = 0.0;
+	for (int i = 0; i <= 100000; i++) {
+		const float x = 1.57079633f * i / 100000;
+		sinError = std::max(sinError, std::fabs(fastmath::sinQuarter(x) - std::sin(static_cast<double>(x))));
+	}
+	ok &= checkResult("fastmath/sinQuarter", sinError, SIN_QUARTER_MAX_ERROR);
+
+	// Tables as the modules instantiate them.
+	double crossfadeError = 0.0;
+	for (int i = 0; i < CROSSFADE_TABLE_SIZE; i++) {
+		const double reference = std::sin(M_PI / 2 * i / (CROSSFADE_TABLE_SIZE - 1));
+		crossfadeError = std::max(crossfadeError, std::fabs(CROSSFADE_GAINS[i] - reference));
+	}
+	ok &= checkResult("fastmath/sinQuarterTable-crossfade", crossfadeError, SIN_QUARTER_MAX_ERROR);
+
+	// Radio Music fade-out gains of one render block.
+	const int POW_TABLE_SIZE = 16;
+	const fastmath::Table<POW_TABLE_SIZE> fadeOut = fastmath::powTable<POW_TABLE_SIZE>(1.0f - 0.05f);
+	double powError = 0.0;
+	for (int i = 0; i < POW_TABLE_SIZE; i++) {
+		const double reference = std::pow(static_cast<double>(1.0f - 0.05f), i + 1);
+		powError = std::max(powError, std::fabs(fadeOut[i] - reference) / reference);
+	}
+	ok &= checkResult("fastmath/powTable-fadeout", powError, POW_TABLE_SIZE * POW_TABLE_MAX_RELATIVE_ERROR_PER_POWER);
+
+	return ok;
+}
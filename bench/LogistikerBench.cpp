@@ -0,0 +1,64 @@
+#include "../src/Logistiker.cpp"
+
+#include "Bench.hpp"
+
+
+void bench::logistikerScenarios(const int64_t frames) {
+	// Internal clock, one map.
+	{
+		Logistiker module;
+		connect(module.outputs[Logistiker::X_OUTPUT], 1);
+		module.params[Logistiker::RATE_PARAM].setValue(6.0f);
+
+		run("logistiker/internal-mono", &module, frames, [](int64_t) {});
+	}
+
+	// 1 kHz external clock with R modulation, 16 maps.
+	{
+		Logistiker module;
+		connect(module.outputs[Logistiker::X_OUTPUT], 1);
+		connect(module.inputs[Logistiker::CLK_INPUT], 16);
+		connect(module.inputs[Logistiker::R_INPUT], 16);
+
+		run("logistiker/external-16ch", &module, frames, [&](int64_t frame) {
+			for (int c = 0; c < 16; c++) {
+				module.inputs[Logistiker::CLK_INPUT].setVoltage(((frame + c) % 48 < 24) ? 10.0f : 0.0f, c);
+				module.inputs[Logistiker::R_INPUT].setVoltage(0.01f * c, c);
+			}
+		});
+	}
+
+	// Oscillator mode at 1 kHz, 16 voices, each oversampling factor.
+	for (const int factor : {1, 2, 4, 8}) {
+		Logistiker module;
+		connect(module.outputs[Logistiker::X_OUTPUT], 1);
+		connect(module.inputs[Logistiker::R_INPUT], 16);
+		module.oscillatorMode = true;
+		module.setOversampling(factor);
+		module.params[Logistiker::RATE_PARAM].setValue(4.0f);
+
+		run("logistiker/oscillator-16ch-" + std::to_string(factor) + "x", &module, frames, [](int64_t) {});
+	}
+
+	// 64 instances in oscillator mode at 2x, 16 voices each, on 1 .. n threads.
+	runScaling<Logistiker>("logistiker/scaling-64x", 64, frames / 16, [](Logistiker &module) {
+		connect(module.outputs[Logistiker::X_OUTPUT], 1);
+		connect(module.inputs[Logistiker::R_INPUT], 16);
+		module.oscillatorMode = true;
+		module.setOversampling(2);
+		module.params[Logistiker::RATE_PARAM].setValue(4.0f);
+		return true;
+	});
+}
+
+bool bench::replayLogistiker(InputCaptureReader &reader) {
+	if (reader.slug != "Logistiker") {
+		return false;
+	}
+	Logistiker module;
+	loadState(&module, reader);
+	// Adaptive quality depends on timing, so the output hash wouldn't be reproducible.
+	module.adaptiveQuality.setBudget(0.0f);
+	replay(&module, reader);
+	return true;
+}
@@ -0,0 +1,60 @@
+#include "../src/Nosering.cpp"
+
+#include "Bench.hpp"
+
+
+static void connectOutputs(Nosering &module) {
+	bench::connect(module.outputs[Nosering::N_PLUS_1_OUTPUT], 1);
+	bench::connect(module.outputs[Nosering::TWO_POW_N_OUTPUT], 1);
+	bench::connect(module.outputs[Nosering::NOISE_OUTPUT], 1);
+}
+
+void bench::noseringScenarios(const int64_t frames) {
+	// Internal clock, one ring.
+	{
+		Nosering module;
+		connectOutputs(module);
+
+		run("nosering/internal-mono", &module, frames, [](int64_t) {});
+	}
+
+	// 2 kHz external clock (sine), 16 rings, each anti-aliasing mode.
+	float clock[24];
+	for (int i = 0; i < 24; i++) {
+		clock[i] = 5.0f * std::sin(2.0f * M_PI * i / 24);
+	}
+
+	const char *modes[NUM_ANTI_ALIASING_MODES] = {"off", "minblep", "oversampled"};
+	for (int mode = 0; mode < NUM_ANTI_ALIASING_MODES; mode++) {
+		Nosering module;
+		connectOutputs(module);
+		connect(module.inputs[Nosering::EXT_RATE_INPUT], 16);
+		module.setAntiAliasing(mode);
+
+		run(std::string("nosering/external-16ch-") + modes[mode], &module, frames, [&](int64_t frame) {
+			for (int c = 0; c < 16; c++) {
+				module.inputs[Nosering::EXT_RATE_INPUT].setVoltage(clock[(frame + c) % 24], c);
+			}
+		});
+	}
+
+	// 64 instances on internal clock, MinBLEP anti-aliasing, on 1 .. n threads.
+	runScaling<Nosering>("nosering/scaling-64x", 64, frames / 16, [](Nosering &module) {
+		connectOutputs(module);
+		module.setAntiAliasing(MINBLEP_ANTI_ALIASING);
+		return true;
+	});
+}
+
+// Output is only reproducible with a fixed noise seed.
+bool bench::replayNosering(InputCaptureReader &reader) {
+	if (reader.slug != "Nosering") {
+		return false;
+	}
+	Nosering module;
+	loadState(&module, reader);
+	// Adaptive quality depends on timing, so the output hash wouldn't be reproducible.
+	module.adaptiveQuality.setBudget(0.0f);
+	replay(&module, reader);
+	return true;
+}
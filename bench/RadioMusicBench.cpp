@@ -0,0 +1,415 @@
+#include "../src/RadioMusic.cpp"
+
+#include "Bench.hpp"
+
+#define BENCH_LIBRARY_DIR "bench-library"
+#define BENCH_STATIONS 16
+#define BENCH_FILE_SECONDS 4
+#define BENCH_FILE_SAMPLE_RATE 44100
+#define BENCH_LOAD_TIMEOUT 300.0 // Seconds
+#define CHECK_FLAC_PATH "bench-check.flac"
+#define CHECK_FLAC_BLOCK_SIZE 4096
+
+
+// Sine of `frequency` Hz, written as WAV with 16 or 24 bit integer or 32 bit
+// float samples, or as headerless 16 bit RAW (bits = 0). Returns the file size.
+static uint64_t writeSine(const std::string &path, const float frequency, const int channels, const int bits,
+	const int sampleRate, const float seconds) {
+	const uint32_t frames = seconds * sampleRate;
+	const int bytesPerSample = (bits == 0) ? 2 : bits / 8;
+	const uint32_t dataSize = frames * channels * bytesPerSample;
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return 0;
+	}
+
+	auto write32 = [&](uint32_t v) { fwrite(&v, 4, 1, file); };
+	auto write16 = [&](uint16_t v) { fwrite(&v, 2, 1, file); };
+
+	if (bits != 0) {
+		fwrite("RIFF", 1, 4, file);
+		write32(36 + dataSize);
+		fwrite("WAVEfmt ", 1, 8, file);
+		write32(16);
+		write16((bits == 32) ? 3 : 1); // IEEE float or PCM
+		write16(channels);
+		write32(sampleRate);
+		write32(sampleRate * channels * bytesPerSample);
+		write16(channels * bytesPerSample);
+		write16(bits);
+		fwrite("data", 1, 4, file);
+		write32(dataSize);
+	}
+
+	std::vector<uint8_t> data(dataSize);
+	uint8_t *out = data.data();
+	for (uint32_t i = 0; i < frames; i++) {
+		const float value = 0.5f * std::sin(2.0f * M_PI * frequency * i / sampleRate);
+		for (int c = 0; c < channels; c++) {
+			if (bits == 32) {
+				std::memcpy(out, &value, 4);
+			} else {
+				const int32_t sample = value * ((bits == 24) ? 8388607.0f : 32767.0f);
+				for (int b = 0; b < bytesPerSample; b++) {
+					out[b] = (sample >> (8 * b)) & 0xff;
+				}
+			}
+			out += bytesPerSample;
+		}
+	}
+	fwrite(data.data(), 1, data.size(), file);
+	fclose(file);
+
+	return (bits == 0) ? dataSize : 44 + dataSize;
+}
+
+static uint8_t flacCrc8(const uint8_t *data, const size_t n) {
+	uint8_t crc = 0;
+	for (size_t i = 0; i < n; i++) {
+		crc ^= data[i];
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+static uint16_t flacCrc16(const uint8_t *data, const size_t n) {
+	uint16_t crc = 0;
+	for (size_t i = 0; i < n; i++) {
+		crc ^= data[i] << 8;
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+// 16 bit FLAC of interleaved `samples`, stored in verbatim (uncompressed)
+// subframes. The frame count in STREAMINFO is 0 (unknown), as encoders
+// writing to a pipe leave it. At most 127 frames. Returns false on failure.
+static bool writeFlac(const std::string &path, const std::vector<int16_t> &samples, const int channels,
+	const int sampleRate) {
+	const uint32_t totalFrames = samples.size() / channels;
+	std::vector<uint8_t> data;
+	auto writeBigEndian = [&data](const uint64_t v, const int bytes) {
+		for (int b = bytes - 1; b >= 0; b--) {
+			data.push_back((v >> (8 * b)) & 0xff);
+		}
+	};
+
+	data.insert(data.end(), {'f', 'L', 'a', 'C'});
+	data.insert(data.end(), {0x80, 0, 0, 34}); // Last metadata block: STREAMINFO
+	writeBigEndian(CHECK_FLAC_BLOCK_SIZE, 2); // Min and max block size
+	writeBigEndian(CHECK_FLAC_BLOCK_SIZE, 2);
+	writeBigEndian(0, 3); // Min and max frame size unknown
+	writeBigEndian(0, 3);
+	writeBigEndian((uint64_t)sampleRate << 44 | (uint64_t)(channels - 1) << 41 | (uint64_t)15 << 36, 8); // 16 bit, 0 frames
+	data.insert(data.end(), 16, 0); // No MD5
+
+	for (uint32_t start = 0, frame = 0; start < totalFrames; start += CHECK_FLAC_BLOCK_SIZE, frame++) {
+		const uint32_t frames = std::min((uint32_t)CHECK_FLAC_BLOCK_SIZE, totalFrames - start);
+		const size_t header = data.size();
+		data.insert(data.end(), {0xff, 0xf8, 0x70}); // Fixed block size, block size at the end, STREAMINFO rate
+		data.push_back((channels - 1) << 4 | 0x08); // Independent channels, 16 bit
+		data.push_back(frame);
+		writeBigEndian(frames - 1, 2);
+		data.push_back(flacCrc8(&data[header], data.size() - header));
+
+		for (int c = 0; c < channels; c++) {
+			data.push_back(0x02); // Verbatim subframe
+			for (uint32_t i = start; i < start + frames; i++) {
+				writeBigEndian((uint16_t)samples[i * channels + c], 2);
+			}
+		}
+		writeBigEndian(flacCrc16(&data[header], data.size() - header), 2);
+	}
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return written;
+}
+
+// Engine side of loading: process() applies commands and swaps in loaded banks.
+static bool waitForBank(RadioMusic &module) {
+	rack::engine::Module::ProcessArgs args;
+	args.sampleRate = 48000.0f;
+	args.sampleTime = 1.0f / args.sampleRate;
+	args.frame = 0;
+
+	for (int i = 0; i < 10000; i++) {
+		for (int j = 0; j < RENDER_BLOCK_SIZE; j++) {
+			module.process(args);
+		}
+		if (module.getCurrentObjectPoolSize() > 0) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// Module with the synthetic bank loaded and output connected.
+static bool setUp(RadioMusic &module, const bool pitchMode, const bool crossfade) {
+	bench::connect(module.outputs[RadioMusic::OUT_OUTPUT], 1);
+	module.setOption(RadioMusic::PITCH_MODE_OPTION, pitchMode);
+	module.setOption(RadioMusic::CROSSFADE_OPTION, crossfade);
+	module.selectAudioPool(BENCH_LIBRARY_DIR);
+
+	if (!waitForBank(module)) {
+		fprintf(stderr, "Loading %s failed\n", BENCH_LIBRARY_DIR);
+		return false;
+	}
+	return true;
+}
+
+void bench::radioMusicScenarios(const int64_t frames) {
+	if (!selected("radiomusic/")) {
+		return;
+	}
+
+	// One bank of sines.
+	const std::string bankDir = system::join(BENCH_LIBRARY_DIR, "bank");
+	system::createDirectories(bankDir);
+	for (int i = 0; i < BENCH_STATIONS; i++) {
+		writeSine(system::join(bankDir, string::f("%02d.wav", i)), 110.0f * (i + 1), 2, 16,
+			BENCH_FILE_SAMPLE_RATE, BENCH_FILE_SECONDS);
+	}
+
+	// One station playing.
+	{
+		RadioMusic module;
+		if (setUp(module, false, false)) {
+			run("radiomusic/playback", &module, frames, [](int64_t) {});
+		}
+	}
+
+	// Station CV sweeps through all stations 10 times per second.
+	{
+		RadioMusic module;
+		if (setUp(module, false, true)) {
+			connect(module.inputs[RadioMusic::STATION_INPUT], 1);
+			run("radiomusic/station-sweep", &module, frames, [&](int64_t frame) {
+				module.inputs[RadioMusic::STATION_INPUT].setVoltage((frame % 4800) * (5.0f / 4800));
+			});
+		}
+	}
+
+	// Pitch mode with the start input modulating the speed.
+	{
+		RadioMusic module;
+		if (setUp(module, true, false)) {
+			connect(module.inputs[RadioMusic::START_INPUT], 1);
+			run("radiomusic/pitch-mode", &module, frames, [&](int64_t frame) {
+				module.inputs[RadioMusic::START_INPUT].setVoltage((frame % 48000) * (2.0f / 48000));
+			});
+		}
+	}
+
+	// Reset every 50 ms with crossfade enabled, so a crossfade is always running.
+	{
+		RadioMusic module;
+		if (setUp(module, false, true)) {
+			connect(module.inputs[RadioMusic::RESET_INPUT], 1);
+			run("radiomusic/crossfade", &module, frames, [&](int64_t frame) {
+				module.inputs[RadioMusic::RESET_INPUT].setVoltage((frame % 2400 < 24) ? 10.0f : 0.0f);
+			});
+		}
+	}
+
+	// 8 instances playing with crossfade enabled, on 1 .. n threads. Each loads its own bank.
+	runScaling<RadioMusic>("radiomusic/scaling-8x", 8, frames / 4, [](RadioMusic &module) {
+		return setUp(module, false, true);
+	});
+
+	system::removeRecursively(BENCH_LIBRARY_DIR);
+}
+
+// Loads the bank of the captured patch from its root directory first.
+bool bench::replayRadioMusic(InputCaptureReader &reader) {
+	if (reader.slug != "RadioMusic") {
+		return false;
+	}
+	RadioMusic module;
+	loadState(&module, reader);
+	// Adaptive quality depends on timing, so the output hash wouldn't be reproducible.
+	module.adaptiveQuality.setBudget(0.0f);
+	if (module.rootDir.empty() || !system::exists(module.rootDir)) {
+		fprintf(stderr, "Root directory \"%s\" of the capture not found\n", module.rootDir.c_str());
+		return true;
+	}
+	module.selectAudioPool(module.rootDir);
+	if (!waitForBank(module)) {
+		fprintf(stderr, "Loading %s failed\n", module.rootDir.c_str());
+		return true;
+	}
+	replay(&module, reader);
+	return true;
+}
+
+
+// Synthetic sample library. Files are spread evenly over the banks. Banks are
+// `depth` directories below the root; the scanner only finds banks up to
+// MAX_DIR_DEPTH levels down, deeper libraries measure the scan only.
+struct LibrarySpec {
+	const char *name;
+	int files;
+	int banks;
+	int depth;
+	int channels;
+	int bits; // 0 = RAW
+	int sampleRate;
+	float seconds;
+};
+
+static const LibrarySpec LIBRARIES[] = {
+	{"loader/10-wav16-44k-stereo", 10, 1, 0, 2, 16, 44100, 5.0f},
+	{"loader/100-wav24-48k-mono", 100, 1, 0, 1, 24, 48000, 1.0f},
+	{"loader/100-wav32f-96k-stereo", 100, 1, 0, 2, 32, 96000, 1.0f},
+	{"loader/100-raw16-44k-mono", 100, 1, 0, 1, 0, 44100, 1.0f},
+	{"loader/1000-wav16-44k-mono-nested", 1000, 16, 1, 1, 16, 44100, 0.5f},
+	{"loader/1000-wav16-44k-mono-deep", 1000, 16, 8, 1, 16, 44100, 0.1f},
+	{"loader/10000-wav16-44k-mono", 10000, 16, 0, 1, 16, 44100, 0.1f}
+};
+
+// Writes the library. Returns the size of one bank in bytes (banks are about the same size).
+static uint64_t generateLibrary(const LibrarySpec &spec) {
+	uint64_t firstBankBytes = 0;
+	for (int bank = 0; bank < spec.banks; bank++) {
+		std::string dir = BENCH_LIBRARY_DIR;
+		for (int d = 0; d < spec.depth; d++) {
+			dir = system::join(dir, string::f("d%d", d));
+		}
+		dir = system::join(dir, string::f("bank%02d", bank));
+		system::createDirectories(dir);
+
+		for (int i = bank; i < spec.files; i += spec.banks) {
+			const std::string path = system::join(dir, string::f("%05d.%s", i, (spec.bits == 0) ? "raw" : "wav"));
+			const uint64_t bytes = writeSine(path, 110.0f + i % 1000, spec.channels, spec.bits, spec.sampleRate, spec.seconds);
+			if (bank == 0) {
+				firstBankBytes += bytes;
+			}
+		}
+	}
+	return firstBankBytes;
+}
+
+// Scan time, time to first sound and full bank load time of each library.
+// Files were just written, so they are read from the page cache.
+void bench::loaderScenarios() {
+	if (!selected("loader/")) {
+		return;
+	}
+
+	printf("\n%-36s %6s %9s %8s %12s %8s %8s %9s\n", "library", "files", "bank MB", "scan ms", "1st sound ms",
+		"load ms", "MB/s", "peak RSS");
+
+	for (const LibrarySpec &spec : LIBRARIES) {
+		if (!selected(spec.name)) {
+			continue;
+		}
+
+		system::removeRecursively(BENCH_LIBRARY_DIR);
+		const uint64_t bankBytes = generateLibrary(spec);
+
+		// Scan
+		FileScanner scanner;
+		double start = system::getTime();
+		scanner.scan(BENCH_LIBRARY_DIR);
+		const double scanTime = system::getTime() - start;
+		const size_t bankFiles = scanner.banks.empty() ? 0 : scanner.banks[0].size();
+
+		// Load the first bank, as the module does: command, scan, decode, swap.
+		double firstSoundTime = -1.0;
+		double loadTime = -1.0;
+		int64_t rss = -1;
+		if (bankFiles > 0) {
+			RadioMusic module;
+			connect(module.outputs[RadioMusic::OUT_OUTPUT], 1);
+
+			rack::engine::Module::ProcessArgs args;
+			args.sampleRate = 48000.0f;
+			args.sampleTime = 1.0f / args.sampleRate;
+			args.frame = 0;
+
+			resetPeakRss();
+			start = system::getTime();
+			module.selectAudioPool(BENCH_LIBRARY_DIR);
+
+			while (firstSoundTime < 0.0 && system::getTime() - start < BENCH_LOAD_TIMEOUT) {
+				for (int i = 0; i < RENDER_BLOCK_SIZE; i++, args.frame++) {
+					module.process(args);
+					if (firstSoundTime < 0.0 && module.outputs[RadioMusic::OUT_OUTPUT].getVoltage() != 0.0f) {
+						firstSoundTime = system::getTime() - start;
+					}
+				}
+				if (loadTime < 0.0 && module.getCurrentObjectPoolSize() > 0) {
+					loadTime = system::getTime() - start;
+				}
+				std::this_thread::yield();
+			}
+			rss = peakRss();
+		}
+
+		const double megabytes = bankBytes / 1e6;
+		printf("%-36s %6d %9.1f %8.1f %12.1f %8.1f %8.1f %7.1fMB\n", spec.name, spec.files, megabytes, 1e3 * scanTime,
+			1e3 * firstSoundTime, 1e3 * loadTime, (loadTime > 0.0) ? megabytes / loadTime : 0.0, rss / 1e6);
+		fflush(stdout);
+
+		json_t *resultJ = json_object();
+		json_object_set_new(resultJ, "name", json_string(spec.name));
+		json_object_set_new(resultJ, "files", json_integer(spec.files));
+		json_object_set_new(resultJ, "banks", json_integer(scanner.banks.size()));
+		json_object_set_new(resultJ, "bankFiles", json_integer(bankFiles));
+		json_object_set_new(resultJ, "bankBytes", json_integer(bankBytes));
+		json_object_set_new(resultJ, "scanSeconds", json_real(scanTime));
+		if (loadTime >= 0.0) {
+			json_object_set_new(resultJ, "loadSeconds", json_real(loadTime));
+			json_object_set_new(resultJ, "bytesPerSecond", json_real(bankBytes / loadTime));
+		}
+		if (firstSoundTime >= 0.0) {
+			json_object_set_new(resultJ, "firstSoundSeconds", json_real(firstSoundTime));
+		}
+		if (rss >= 0) {
+			json_object_set_new(resultJ, "peakRssBytes", json_integer(rss));
+		}
+		record(resultJ);
+	}
+
+	system::removeRecursively(BENCH_LIBRARY_DIR);
+}
+
+// A FLAC without a frame count, longer than one load chunk.
+bool bench::checkLoaders() {
+	const int channels = 2;
+	const uint32_t frames = LOAD_CHUNK_FRAMES + 34464;
+	std::vector<int16_t> written(frames * channels);
+	for (uint32_t i = 0; i < frames; i++) {
+		for (int c = 0; c < channels; c++) {
+			written[i * channels + c] = 32767.0f * std::sin(2.0f * M_PI * (110.0f + 55.0f * c) * i / BENCH_FILE_SAMPLE_RATE);
+		}
+	}
+
+	double error = 1.0;
+	if (writeFlac(CHECK_FLAC_PATH, written, channels, BENCH_FILE_SAMPLE_RATE)) {
+		FlacAudioObject object;
+		if (object.load(CHECK_FLAC_PATH) && object.totalSamples == written.size() && object.channels == (unsigned int)channels) {
+			error = 0.0;
+			float peak = 0.0f;
+			for (size_t i = 0; i < written.size(); i++) {
+				const float expected = written[i] / 32768.0f;
+				error = std::max(error, (double)std::fabs(object.samples[i] - expected));
+				peak = std::max(peak, std::fabs(expected));
+			}
+			error = std::max(error, (double)std::fabs(object.peak - peak));
+		}
+	}
+	system::remove(CHECK_FLAC_PATH);
+
+	return checkResult("loader/flac-unknown-length", error, 0.0);
+}
@@ -0,0 +1,377 @@
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "Bench.hpp"
+#include "Cpu.hpp"
+#include "PcmKernels.hpp"
+#include "RtSafety.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Module sources are built into the benchmark, not loaded as a plugin.
+Plugin *pluginInstance = nullptr;
+
+namespace bench {
+
+std::string filter;
+static json_t *resultsJ = nullptr;
+
+#ifdef __linux__
+static int openCounter(const uint64_t config) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int64_t readCounter(const int fd) {
+	int64_t value = -1;
+	if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+		return -1;
+	}
+	return value;
+}
+
+PerfCounters::PerfCounters() :
+  cyclesFd(openCounter(PERF_COUNT_HW_CPU_CYCLES)),
+  cacheMissesFd(openCounter(PERF_COUNT_HW_CACHE_MISSES)),
+  cycleCount(-1),
+  cacheMissCount(-1)
+  {}
+
+PerfCounters::~PerfCounters() {
+	if (cyclesFd >= 0) close(cyclesFd);
+	if (cacheMissesFd >= 0) close(cacheMissesFd);
+}
+
+void PerfCounters::start() {
+	for (const int fd : {cyclesFd, cacheMissesFd}) {
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void PerfCounters::stop() {
+	for (const int fd : {cyclesFd, cacheMissesFd}) {
+		if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	}
+	cycleCount = readCounter(cyclesFd);
+	cacheMissCount = readCounter(cacheMissesFd);
+}
+#else
+PerfCounters::PerfCounters() :
+  cyclesFd(-1),
+  cacheMissesFd(-1),
+  cycleCount(-1),
+  cacheMissCount(-1)
+  {}
+
+PerfCounters::~PerfCounters() {}
+void PerfCounters::start() {}
+void PerfCounters::stop() {}
+#endif
+
+json_t *report(const std::string &name, const int64_t frames, const double seconds, const PerfCounters &counters) {
+	char cycles[32] = "n/a";
+	char cacheMisses[32] = "n/a";
+	if (counters.cycles() >= 0) {
+		snprintf(cycles, sizeof(cycles), "%.1f", static_cast<double>(counters.cycles()) / frames);
+	}
+	if (counters.cacheMisses() >= 0) {
+		snprintf(cacheMisses, sizeof(cacheMisses), "%.4f", static_cast<double>(counters.cacheMisses()) / frames);
+	}
+
+	printf("%-36s %10.1f %12s %14s\n", name.c_str(), 1e9 * seconds / frames, cycles, cacheMisses);
+	fflush(stdout);
+
+	json_t *resultJ = json_object();
+	json_object_set_new(resultJ, "name", json_string(name.c_str()));
+	json_object_set_new(resultJ, "frames", json_integer(frames));
+	json_object_set_new(resultJ, "nsPerSample", json_real(1e9 * seconds / frames));
+	if (counters.cycles() >= 0) {
+		json_object_set_new(resultJ, "cyclesPerSample", json_real(static_cast<double>(counters.cycles()) / frames));
+	}
+	if (counters.cacheMisses() >= 0) {
+		json_object_set_new(resultJ, "cacheMissesPerSample", json_real(static_cast<double>(counters.cacheMisses()) / frames));
+	}
+	return record(resultJ);
+}
+
+json_t *record(json_t *resultJ) {
+	if (resultsJ) {
+		json_array_append_new(resultsJ, resultJ);
+		return resultJ;
+	}
+	json_decref(resultJ);
+	return nullptr;
+}
+
+// Sense-reversing barrier. Spins, then yields when there are more threads than cores.
+struct SpinBarrier {
+	explicit SpinBarrier(const int threads) : threads(threads) {}
+
+	void wait() {
+		const int current = generation.load(std::memory_order_acquire);
+		if (count.fetch_add(1, std::memory_order_acq_rel) == threads - 1) {
+			count.store(0, std::memory_order_relaxed);
+			generation.store(current + 1, std::memory_order_release);
+			return;
+		}
+		for (int spins = 0; generation.load(std::memory_order_acquire) == current; spins++) {
+			if (spins > 1000) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+private:
+
+	const int threads;
+	alignas(64) std::atomic<int> count{0};
+	alignas(64) std::atomic<int> generation{0};
+};
+
+// Processes `frames` frames of `modules` on `threads` threads. Returns the seconds taken.
+static double processOnThreads(const std::vector<rack::engine::Module*> &modules, const int64_t frames,
+	const int threads) {
+	SpinBarrier barrier(threads);
+	std::chrono::steady_clock::time_point startTime;
+
+	auto work = [&](const int thread) {
+		rack::engine::Module::ProcessArgs args;
+		args.sampleRate = 48000.0f;
+		args.sampleTime = 1.0f / args.sampleRate;
+		args.frame = 0;
+
+		barrier.wait();
+		if (thread == 0) {
+			startTime = std::chrono::steady_clock::now();
+		}
+		for (int64_t i = 0; i < frames; i++, args.frame++) {
+			for (size_t m = thread; m < modules.size(); m += threads) {
+				modules[m]->process(args);
+			}
+			barrier.wait();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (int t = 1; t < threads; t++) {
+		workers.emplace_back(work, t);
+	}
+	work(0);
+	for (std::thread &t : workers) {
+		t.join();
+	}
+
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+	return elapsed.count();
+}
+
+void runThreads(const std::string &name, const std::vector<rack::engine::Module*> &modules, const int64_t frames) {
+	const int maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	// Warm-up
+	processOnThreads(modules, frames / 10, 1);
+
+	// Hardware counters only cover the calling thread, so they aren't reported.
+	const PerfCounters counters;
+	const int64_t moduleFrames = frames * modules.size();
+	double singleThreadSeconds = 0.0;
+	for (const int threads : threadCounts) {
+		const double seconds = processOnThreads(modules, frames, threads);
+		if (threads == 1) {
+			singleThreadSeconds = seconds;
+		}
+		const double speedup = singleThreadSeconds / seconds;
+
+		json_t *resultJ = report(name + "/" + std::to_string(threads) + "t", moduleFrames, seconds, counters);
+		printf("speedup %.2f on %d threads (%.0f%% of linear)\n", speedup, threads, 100.0 * speedup / threads);
+		if (resultJ) {
+			json_object_set_new(resultJ, "threads", json_integer(threads));
+			json_object_set_new(resultJ, "instances", json_integer(modules.size()));
+			json_object_set_new(resultJ, "speedup", json_real(speedup));
+		}
+	}
+}
+
+// FNV-1a
+static uint64_t hashValue(uint64_t hash, const float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 4; i++) {
+		hash ^= (bits >> (8 * i)) & 0xff;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+void loadState(rack::engine::Module *module, const InputCaptureReader &reader) {
+	json_t *stateJ = json_loads(reader.state.c_str(), 0, nullptr);
+	if (stateJ) {
+		module->dataFromJson(stateJ);
+		json_decref(stateJ);
+	}
+}
+
+void replay(rack::engine::Module *module, InputCaptureReader &reader) {
+	rack::engine::Module::ProcessArgs args;
+	args.sampleRate = reader.sampleRate;
+	args.sampleTime = 1.0f / reader.sampleRate;
+	args.frame = 0;
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	// Applying the capture and hashing are measured too. Both cost the same in every build.
+	PerfCounters counters;
+	const auto startTime = std::chrono::steady_clock::now();
+	counters.start();
+
+	while (reader.apply(module, args.frame)) {
+		module->process(args);
+		for (rack::engine::Output &output : module->outputs) {
+			const int channels = output.getChannels();
+			hash = hashValue(hash, channels);
+			for (int c = 0; c < channels; c++) {
+				hash = hashValue(hash, output.getVoltage(c));
+			}
+		}
+		args.frame++;
+	}
+
+	counters.stop();
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+
+	if (args.frame == 0) {
+		fprintf(stderr, "Capture is empty\n");
+		return;
+	}
+
+	const std::string hashString = string::f("%016llx", (unsigned long long)hash);
+	json_t *resultJ = report("replay/" + reader.slug, args.frame, elapsed.count(), counters);
+	printf("output hash %s (%.1f s of audio)\n", hashString.c_str(), args.frame / reader.sampleRate);
+	if (resultJ) {
+		json_object_set_new(resultJ, "outputHash", json_string(hashString.c_str()));
+	}
+}
+
+void resetPeakRss() {
+#ifdef __linux__
+	// Resets VmHWM (Linux 4.0+).
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file) {
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
+
+int64_t peakRss() {
+#ifdef __linux__
+	FILE *file = fopen("/proc/self/status", "r");
+	if (file) {
+		char line[256];
+		long kb = -1;
+		while (fgets(line, sizeof(line), file)) {
+			if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+		}
+		fclose(file);
+		return (kb >= 0) ? static_cast<int64_t>(kb) * 1024 : -1;
+	}
+	return -1;
+#elif defined(_WIN32)
+	return -1;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return -1;
+	}
+	return usage.ru_maxrss; // Bytes on macOS
+#endif
+}
+
+} // namespace bench
+
+
+// Usage: bench [filter] [frames] [results.json]
+//        bench replay capture.m80cap [results.json]
+//        bench check [results.json]
+int main(int argc, char *argv[]) {
+	const bool replay = (argc > 2) && (std::strcmp(argv[1], "replay") == 0);
+	const bool check = (argc > 1) && (std::strcmp(argv[1], "check") == 0);
+	if (argc > 1 && !replay && !check) {
+		bench::filter = argv[1];
+	}
+	const int64_t frames = (argc > 2 && !replay && !check) ? std::atoll(argv[2]) : (1 << 20);
+	const char *resultsPath = check ? ((argc > 2) ? argv[2] : nullptr) : ((argc > 3) ? argv[3] : nullptr);
+	if (resultsPath) {
+		bench::resultsJ = json_array();
+	}
+
+	random::init();
+	cpu::init();
+
+	int status = 0;
+	if (check) {
+		if (!bench::checkFastMath() || !bench::checkLoaders()) {
+			status = 1;
+		}
+	} else if (replay) {
+		InputCaptureReader reader;
+		if (!reader.open(argv[2])) {
+			fprintf(stderr, "Failed to read capture %s\n", argv[2]);
+			return 1;
+		}
+		printf("%-36s %10s %12s %14s\n", "capture", "ns/sample", "cycles/sample", "misses/sample");
+		if (!bench::replayLogistiker(reader) && !bench::replayNosering(reader) && !bench::replayRadioMusic(reader)) {
+			fprintf(stderr, "Unknown module %s\n", reader.slug.c_str());
+			return 1;
+		}
+	} else {
+		printf("%-36s %10s %12s %14s\n", "scenario", "ns/sample", "cycles/sample", "misses/sample");
+		bench::logistikerScenarios(frames);
+		bench::noseringScenarios(frames);
+		bench::radioMusicScenarios(frames);
+		bench::loaderScenarios();
+	}
+
+	if (resultsPath) {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "kernels", json_string(pcm::kernelName()));
+		json_object_set_new(rootJ, "results", bench::resultsJ);
+		if (json_dump_file(rootJ, resultsPath, JSON_INDENT(2)) != 0) {
+			fprintf(stderr, "Failed to write %s\n", resultsPath);
+		}
+		json_decref(rootJ);
+	}
+
+#ifdef RT_SAFETY_CHECK
+	// Setup code runs process() too (e.g. while loading banks), so its violations count as well.
+	if (rtsafety::violations() > 0) {
+		return 2;
+	}
+#endif
+
+	return status;
+}
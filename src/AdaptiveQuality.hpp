@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "rack.hpp"
+
+#define ADAPTIVE_QUALITY_LEVELS 3           // Full, reduced, minimal
+#define ADAPTIVE_QUALITY_WINDOW 4096        // Frames per load measurement
+#define ADAPTIVE_QUALITY_TIMING_INTERVAL 7  // Every 7th frame is timed (prime, so render blocks don't alias)
+#define ADAPTIVE_QUALITY_RECOVERY 16        // Windows below half the budget before stepping back up
+#define ADAPTIVE_QUALITY_MAX_RECOVERY 256
+
+
+// Watches the processing time of a module against a CPU budget (share of real
+// time). Over budget, the module steps down to cheaper modes at once. It
+// steps back up after a while below half the budget. Stepping down again
+// soon after stepping up doubles that wait, so the level doesn't oscillate.
+struct AdaptiveQuality {
+
+	enum Level {
+		FULL_QUALITY,
+		REDUCED_QUALITY,
+		MINIMAL_QUALITY
+	};
+
+	AdaptiveQuality() :
+	  budget(0.0f),
+	  level(FULL_QUALITY),
+	  load(0.0f),
+	  changes(0),
+	  frames(0),
+	  timedNs(0),
+	  recovery(ADAPTIVE_QUALITY_RECOVERY),
+	  windowsBelow(0),
+	  windowsSinceChange(0),
+	  timingCounter(0)
+	  {}
+
+	// Times the enclosing scope (the module's process()).
+	struct Timer {
+
+		Timer(AdaptiveQuality &quality, const rack::engine::Module::ProcessArgs &args) :
+		  quality(quality),
+		  sampleTime(args.sampleTime),
+		  start(quality.begin())
+		  {}
+
+		~Timer() {
+			quality.end(start, sampleTime);
+		}
+
+	private:
+
+		AdaptiveQuality &quality;
+		const float sampleTime;
+		const int64_t start;
+
+	};
+
+	// Engine thread
+	Level getLevel() const {
+		return static_cast<Level>(level.load(std::memory_order_relaxed));
+	}
+
+	// May be called from the UI thread. 0 disables adaptation (full quality).
+	void setBudget(const float newBudget) {
+		budget = rack::math::clamp(newBudget, 0.0f, 1.0f);
+	}
+
+	float getBudget() const {
+		return budget;
+	}
+
+	// Share of real time used in the last window (estimated from the timed frames).
+	float getLoad() const {
+		return load.load(std::memory_order_relaxed);
+	}
+
+	uint64_t getChanges() const {
+		return changes.load(std::memory_order_relaxed);
+	}
+
+	json_t *toJson() const {
+		return json_real(budget);
+	}
+
+	void fromJson(json_t *budgetJ) {
+		if (budgetJ) setBudget(json_number_value(budgetJ));
+	}
+
+	static const char *levelName(const Level level) {
+		switch (level) {
+			case REDUCED_QUALITY: return "Reduced";
+			case MINIMAL_QUALITY: return "Minimal";
+			default: return "Full";
+		}
+	}
+
+private:
+
+	static int64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Start time of a timed frame, 0 otherwise.
+	int64_t begin() {
+		if (++timingCounter < ADAPTIVE_QUALITY_TIMING_INTERVAL) {
+			return 0;
+		}
+		timingCounter = 0;
+		return now();
+	}
+
+	void end(const int64_t start, const float sampleTime) {
+		if (start != 0) {
+			timedNs += now() - start;
+		}
+		if (++frames < ADAPTIVE_QUALITY_WINDOW) {
+			return;
+		}
+
+		const float windowLoad = timedNs * ADAPTIVE_QUALITY_TIMING_INTERVAL / (1e9f * sampleTime * frames);
+		frames = 0;
+		timedNs = 0;
+		load.store(windowLoad, std::memory_order_relaxed);
+
+		const float maxLoad = budget;
+		int newLevel = level.load(std::memory_order_relaxed);
+		windowsSinceChange++;
+
+		if (maxLoad <= 0.0f) {
+			newLevel = FULL_QUALITY;
+		} else if (windowLoad > maxLoad) {
+			windowsBelow = 0;
+			if (newLevel < MINIMAL_QUALITY) {
+				// Back under pressure right after stepping up: wait longer next time.
+				if (windowsSinceChange <= ADAPTIVE_QUALITY_RECOVERY) {
+					recovery = std::min(2 * recovery, ADAPTIVE_QUALITY_MAX_RECOVERY);
+				}
+				newLevel++;
+			}
+		} else if (windowLoad < 0.5f * maxLoad) {
+			if (++windowsBelow >= recovery && newLevel > FULL_QUALITY) {
+				windowsBelow = 0;
+				newLevel--;
+			}
+		} else {
+			windowsBelow = 0;
+		}
+
+		if (newLevel != level.load(std::memory_order_relaxed)) {
+			level.store(newLevel, std::memory_order_relaxed);
+			changes.store(changes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			windowsSinceChange = 0;
+		} else if (windowsSinceChange >= ADAPTIVE_QUALITY_MAX_RECOVERY) {
+			// Stable for long enough.
+			recovery = ADAPTIVE_QUALITY_RECOVERY;
+		}
+	}
+
+	std::atomic<float> budget;
+	std::atomic<int> level;
+	std::atomic<float> load;
+	std::atomic<uint64_t> changes;
+
+	// Engine thread
+	int frames;
+	int64_t timedNs;
+	int recovery;
+	int windowsBelow;
+	int windowsSinceChange;
+	int timingCounter;
+
+};
+
+
+// Context menu entry for the CPU budget, showing the current level and load.
+inline rack::ui::MenuItem *createAdaptiveQualityMenuItem(AdaptiveQuality *quality) {
+	return rack::createSubmenuItem("Adaptive quality", "",
+		[=](rack::ui::Menu *menu) {
+			static const float budgets[] = {0.0f, 0.01f, 0.02f, 0.05f, 0.1f};
+			for (const float budget : budgets) {
+				const std::string text = (budget > 0.0f) ? rack::string::f("%g%% CPU budget", 100.0f * budget) : "Off";
+				menu->addChild(rack::createCheckMenuItem(text, "",
+					[=]() { return quality->getBudget() == budget; },
+					[=]() { quality->setBudget(budget); }));
+			}
+			menu->addChild(new rack::ui::MenuSeparator);
+			menu->addChild(rack::createMenuLabel(rack::string::f("Current: %s quality, %.1f%% CPU",
+				AdaptiveQuality::levelName(quality->getLevel()), 100.0f * quality->getLoad())));
+		});
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "rack.hpp"
+
+#include "BlockKernels.hpp"
+#include "Cpu.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLOCK_KERNELS_X86
+#endif
+
+
+namespace block {
+
+// Variants, one translation unit each (BlockKernels<Isa>.cpp).
+#define DECLARE_BLOCK_KERNELS(variant) \
+	namespace variant { \
+	void decimate(DecimatorLanes &decimator, const float *in, const int lanes, float *out); \
+	void interpolate(const float *samples, const uint64_t totalSamples, const float *positions, const int frames, \
+					 const unsigned int channel, const float gain, float *out); \
+	void crossfadeMix(float *incoming, const float *outgoing, const int frames, \
+					  const float in0, const float in1, const float out0, const float out1); \
+	void noise(NoiseLanes &state, float *out, const int frames, const int lanes, const int colour); \
+	void logisticOscillator(LogisticLanes &maps, const float *r, const float resetX, const float deltaPhase, \
+							const bool interpolate, const int lanes, const int frames, float *out); \
+	}
+
+DECLARE_BLOCK_KERNELS(baseline)
+#ifdef BLOCK_KERNELS_X86
+DECLARE_BLOCK_KERNELS(avx2)
+DECLARE_BLOCK_KERNELS(avx512)
+#endif
+
+namespace {
+
+struct Kernels {
+	void (*decimate)(DecimatorLanes&, const float*, const int, float*);
+	void (*interpolate)(const float*, const uint64_t, const float*, const int, const unsigned int, const float, float*);
+	void (*crossfadeMix)(float*, const float*, const int, const float, const float, const float, const float);
+	void (*noise)(NoiseLanes&, float*, const int, const int, const int);
+	void (*logisticOscillator)(LogisticLanes&, const float*, const float, const float, const bool, const int, const int, float*);
+};
+
+#define BLOCK_KERNELS(variant) \
+	{variant::decimate, variant::interpolate, variant::crossfadeMix, variant::noise, variant::logisticOscillator}
+
+Kernels selectKernels() {
+	switch (cpu::selected()) {
+#ifdef BLOCK_KERNELS_X86
+		case cpu::AVX512_ISA: return BLOCK_KERNELS(avx512);
+		case cpu::AVX2_ISA: return BLOCK_KERNELS(avx2);
+#endif
+		default: return BLOCK_KERNELS(baseline);
+	}
+}
+
+const Kernels &kernels() {
+	static const Kernels selected = selectKernels();
+	return selected;
+}
+
+// Kernel of Rack's decimator of the same size, so the lanes filter exactly like it.
+template <int OVERSAMPLE>
+void copyRackKernel(DecimatorLanes &decimator) {
+	const rack::dsp::Decimator<OVERSAMPLE, DECIMATOR_QUALITY> rackDecimator;
+	std::copy(rackDecimator.kernel, rackDecimator.kernel + OVERSAMPLE * DECIMATOR_QUALITY, decimator.kernel);
+	decimator.oversample = OVERSAMPLE;
+}
+
+} // namespace
+
+
+void initDecimator(DecimatorLanes &decimator, const int oversample) {
+	switch (oversample) {
+		case 2: copyRackKernel<2>(decimator); break;
+		case 4: copyRackKernel<4>(decimator); break;
+		default: copyRackKernel<8>(decimator); break;
+	}
+	decimator.index = 0;
+	std::fill(&decimator.history[0][0], &decimator.history[0][0] + DECIMATOR_MAX_TAPS * BLOCK_LANES, 0.0f);
+}
+
+void decimate(DecimatorLanes &decimator, const float *in, const int lanes, float *out) {
+	kernels().decimate(decimator, in, lanes, out);
+}
+
+void interpolate(const float *samples, const uint64_t totalSamples, const float *positions, const int frames,
+				 const unsigned int channel, const float gain, float *out) {
+	kernels().interpolate(samples, totalSamples, positions, frames, channel, gain, out);
+}
+
+void crossfadeMix(float *incoming, const float *outgoing, const int frames,
+				  const float in0, const float in1, const float out0, const float out1) {
+	kernels().crossfadeMix(incoming, outgoing, frames, in0, in1, out0, out1);
+}
+
+void noise(NoiseLanes &state, float *out, const int frames, const int lanes, const int colour) {
+	kernels().noise(state, out, frames, lanes, colour);
+}
+
+void logisticOscillator(LogisticLanes &maps, const float *r, const float resetX, const float deltaPhase,
+						const bool interpolate, const int lanes, const int frames, float *out) {
+	kernels().logisticOscillator(maps, r, resetX, deltaPhase, interpolate, lanes, frames, out);
+}
+
+} // namespace block
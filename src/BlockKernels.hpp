@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define BLOCK_LANES 16 // PORT_MAX_CHANNELS
+#define DECIMATOR_QUALITY 8
+#define DECIMATOR_MAX_TAPS (8 * DECIMATOR_QUALITY)
+
+
+// Vectorized per-block processing of the modules: rendering and crossfading
+// of RadioMusic stations, and the lanes (one per channel) of Nosering and
+// Logistiker. The best ISA variant for the host CPU is selected at runtime
+// (see Cpu.hpp). Lanes are processed in groups of 4, as many at once as the
+// vectors hold, with the same operations in every variant: the output doesn't
+// depend on the CPU.
+namespace block {
+
+// xoshiro128+ generators and colour filters of the noise lanes (see Noise.hpp).
+struct NoiseLanes {
+	uint32_t s0[BLOCK_LANES];
+	uint32_t s1[BLOCK_LANES];
+	uint32_t s2[BLOCK_LANES];
+	uint32_t s3[BLOCK_LANES];
+	float pink0[BLOCK_LANES];
+	float pink1[BLOCK_LANES];
+	float pink2[BLOCK_LANES];
+	float brown[BLOCK_LANES];
+};
+
+// Logistic maps iterated by an internal clock, one per lane.
+struct LogisticLanes {
+	float x[BLOCK_LANES];
+	float lastX[BLOCK_LANES];
+	float phase[BLOCK_LANES];
+	float reset[BLOCK_LANES]; // Lane mask, x restarts on the next step
+};
+
+// Equivalent of rack::dsp::Decimator<oversample, DECIMATOR_QUALITY> in each lane.
+// Lanes share the write position.
+struct DecimatorLanes {
+	int oversample;
+	int index;
+	float kernel[DECIMATOR_MAX_TAPS];
+	float history[DECIMATOR_MAX_TAPS][BLOCK_LANES];
+};
+
+// Sets up a decimator (oversample 2, 4 or 8) with the kernel of Rack and clears it.
+void initDecimator(DecimatorLanes &decimator, const int oversample);
+
+// Decimates `oversample` rows of BLOCK_LANES samples to one sample per lane.
+void decimate(DecimatorLanes &decimator, const float *in, const int lanes, float *out);
+
+// Linearly interpolated samples of one channel of interleaved audio at the
+// given positions (of the first channel), multiplied by `gain`. 0 past the end.
+void interpolate(const float *samples, const uint64_t totalSamples, const float *positions, const int frames,
+				 const unsigned int channel, const float gain, float *out);
+
+// Mixes `outgoing` into `incoming` in place, with gains ramped linearly from
+// in0/out0 at the first frame towards in1/out1 at `frames`.
+void crossfadeMix(float *incoming, const float *outgoing, const int frames,
+				  const float in0, const float in1, const float out0, const float out1);
+
+// `frames` rows of BLOCK_LANES noise samples of a noise::Colour.
+void noise(NoiseLanes &state, float *out, const int frames, const int lanes, const int colour);
+
+// Runs the maps for `frames` (oversampled) frames with phase increment `deltaPhase`,
+// iterating each with its `r` when its phase wraps. Writes rows of BLOCK_LANES
+// values of x, optionally interpolated between iterates.
+void logisticOscillator(LogisticLanes &maps, const float *r, const float resetX, const float deltaPhase,
+						const bool interpolate, const int lanes, const int frames, float *out);
+
+} // namespace block
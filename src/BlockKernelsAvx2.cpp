@@ -0,0 +1,11 @@
+// AVX2 variant of the block kernels, built with -mavx2 -mfma (see Makefile).
+#if defined(__x86_64__) || defined(__i386__)
+
+#ifndef __AVX2__
+#error "Build with -mavx2 -mfma (see Makefile)"
+#endif
+
+#define BLOCK_KERNELS_NAMESPACE avx2
+#include "BlockKernelsImpl.hpp"
+
+#endif
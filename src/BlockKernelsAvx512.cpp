@@ -0,0 +1,11 @@
+// AVX-512 variant of the block kernels, built with -mavx512f (see Makefile).
+#if defined(__x86_64__) || defined(__i386__)
+
+#ifndef __AVX512F__
+#error "Build with -mavx512f (see Makefile)"
+#endif
+
+#define BLOCK_KERNELS_NAMESPACE avx512
+#include "BlockKernelsImpl.hpp"
+
+#endif
@@ -0,0 +1,3 @@
+// Baseline variant of the block kernels, built with the flags of Rack.
+#define BLOCK_KERNELS_NAMESPACE baseline
+#include "BlockKernelsImpl.hpp"
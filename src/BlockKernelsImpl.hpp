@@ -0,0 +1,461 @@
+// Block kernels, compiled once per ISA variant. Each BlockKernels<Isa>.cpp defines
+// BLOCK_KERNELS_NAMESPACE and includes this file; the vector widths follow the
+// compiler flags of that file (see Makefile).
+//
+// The kernels are written once against the vector types below. Every width
+// performs the same float operations in the same order, and the variants are
+// built without FMA contraction, so results are bit-identical across CPUs
+// (and to the float_4 code of the modules).
+//
+// No std:: templates here: their out-of-line copies would be merged across
+// variants by the linker and could run on a CPU that lacks the instructions.
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "BlockKernels.hpp"
+#include "Noise.hpp"
+
+#ifndef BLOCK_KERNELS_NAMESPACE
+#error "Define BLOCK_KERNELS_NAMESPACE before including BlockKernelsImpl.hpp"
+#endif
+
+
+namespace block {
+namespace BLOCK_KERNELS_NAMESPACE {
+
+namespace {
+
+union FloatBits {
+	float f;
+	uint32_t u;
+};
+
+// Scalar fallback and tails.
+struct Vec1 {
+	typedef float F;
+	typedef bool M;
+	typedef uint32_t I;
+	enum { WIDTH = 1 };
+
+	static F load(const float *p) { return *p; }
+	static void store(float *p, const F v) { *p = v; }
+	static F set1(const float x) { return x; }
+	static F ramp() { return 0.0f; }
+	static F add(const F a, const F b) { return a + b; }
+	static F sub(const F a, const F b) { return a - b; }
+	static F mul(const F a, const F b) { return a * b; }
+	// Operand order of minps/maxps
+	static F min(const F a, const F b) { return (a < b) ? a : b; }
+	static F max(const F a, const F b) { return (a > b) ? a : b; }
+	static M greaterEqual(const F a, const F b) { return a >= b; }
+	static M less(const F a, const F b) { return a < b; }
+	static M both(const M a, const M b) { return a && b; }
+	static M unless(const M a, const M b) { return a && !b; }
+	static F select(const M m, const F a, const F b) { return m ? a : b; }
+	static M loadMask(const float *p) { FloatBits bits; bits.f = *p; return bits.u != 0; }
+	static void storeMask(float *p, const M m) { FloatBits bits; bits.u = m ? 0xffffffffu : 0u; *p = bits.f; }
+
+	static I loadBits(const uint32_t *p) { return *p; }
+	static void storeBits(uint32_t *p, const I v) { *p = v; }
+	static I setBits(const uint32_t x) { return x; }
+	static I addBits(const I a, const I b) { return a + b; }
+	static I xorBits(const I a, const I b) { return a ^ b; }
+	static I orBits(const I a, const I b) { return a | b; }
+	template <int N> static I shiftLeft(const I v) { return v << N; }
+	template <int N> static I shiftRight(const I v) { return v >> N; }
+	static F asFloat(const I v) { FloatBits bits; bits.u = v; return bits.f; }
+
+	// Sample indices (< 2^31)
+	static I truncate(const F v) { return static_cast<uint32_t>(static_cast<int32_t>(v)); }
+	static F toFloat(const I v) { return static_cast<float>(static_cast<int32_t>(v)); }
+	static I nextIndex(const I v, const int32_t last) {
+		const int32_t next = static_cast<int32_t>(v) + 1;
+		return static_cast<uint32_t>((next < last) ? next : last);
+	}
+	static F gather(const float *base, const I index, const M m) { return m ? base[static_cast<int32_t>(index)] : 0.0f; }
+};
+
+#if defined(__SSE2__)
+struct Vec4 {
+	typedef __m128 F;
+	typedef __m128 M;
+	typedef __m128i I;
+	enum { WIDTH = 4 };
+
+	static F load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, const F v) { _mm_storeu_ps(p, v); }
+	static F set1(const float x) { return _mm_set1_ps(x); }
+	static F ramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+	static F add(const F a, const F b) { return _mm_add_ps(a, b); }
+	static F sub(const F a, const F b) { return _mm_sub_ps(a, b); }
+	static F mul(const F a, const F b) { return _mm_mul_ps(a, b); }
+	static F min(const F a, const F b) { return _mm_min_ps(a, b); }
+	static F max(const F a, const F b) { return _mm_max_ps(a, b); }
+	static M greaterEqual(const F a, const F b) { return _mm_cmpge_ps(a, b); }
+	static M less(const F a, const F b) { return _mm_cmplt_ps(a, b); }
+	static M both(const M a, const M b) { return _mm_and_ps(a, b); }
+	static M unless(const M a, const M b) { return _mm_andnot_ps(b, a); }
+	static F select(const M m, const F a, const F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	static M loadMask(const float *p) { return _mm_loadu_ps(p); }
+	static void storeMask(float *p, const M m) { _mm_storeu_ps(p, m); }
+
+	static I loadBits(const uint32_t *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	static void storeBits(uint32_t *p, const I v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+	static I setBits(const uint32_t x) { return _mm_set1_epi32(static_cast<int>(x)); }
+	static I addBits(const I a, const I b) { return _mm_add_epi32(a, b); }
+	static I xorBits(const I a, const I b) { return _mm_xor_si128(a, b); }
+	static I orBits(const I a, const I b) { return _mm_or_si128(a, b); }
+	template <int N> static I shiftLeft(const I v) { return _mm_slli_epi32(v, N); }
+	template <int N> static I shiftRight(const I v) { return _mm_srli_epi32(v, N); }
+	static F asFloat(const I v) { return _mm_castsi128_ps(v); }
+
+	static I truncate(const F v) { return _mm_cvttps_epi32(v); }
+	static F toFloat(const I v) { return _mm_cvtepi32_ps(v); }
+	static I nextIndex(const I v, const int32_t last) {
+		const I next = _mm_add_epi32(v, _mm_set1_epi32(1));
+		const I lastV = _mm_set1_epi32(last);
+		const I below = _mm_cmplt_epi32(next, lastV);
+		return _mm_or_si128(_mm_and_si128(below, next), _mm_andnot_si128(below, lastV));
+	}
+	// No gather before AVX2.
+	static F gather(const float *base, const I index, const M m) {
+		int32_t indices[4];
+		float values[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(indices), index);
+		const int lanes = _mm_movemask_ps(m);
+		for (int i = 0; i < 4; i++) {
+			values[i] = (lanes & (1 << i)) ? base[indices[i]] : 0.0f;
+		}
+		return _mm_loadu_ps(values);
+	}
+};
+#endif
+
+#if defined(__AVX2__)
+struct Vec8 {
+	typedef __m256 F;
+	typedef __m256 M;
+	typedef __m256i I;
+	enum { WIDTH = 8 };
+
+	static F load(const float *p) { return _mm256_loadu_ps(p); }
+	static void store(float *p, const F v) { _mm256_storeu_ps(p, v); }
+	static F set1(const float x) { return _mm256_set1_ps(x); }
+	static F ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+	static F add(const F a, const F b) { return _mm256_add_ps(a, b); }
+	static F sub(const F a, const F b) { return _mm256_sub_ps(a, b); }
+	static F mul(const F a, const F b) { return _mm256_mul_ps(a, b); }
+	static F min(const F a, const F b) { return _mm256_min_ps(a, b); }
+	static F max(const F a, const F b) { return _mm256_max_ps(a, b); }
+	static M greaterEqual(const F a, const F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OS); }
+	static M less(const F a, const F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OS); }
+	static M both(const M a, const M b) { return _mm256_and_ps(a, b); }
+	static M unless(const M a, const M b) { return _mm256_andnot_ps(b, a); }
+	static F select(const M m, const F a, const F b) { return _mm256_or_ps(_mm256_and_ps(m, a), _mm256_andnot_ps(m, b)); }
+	static M loadMask(const float *p) { return _mm256_loadu_ps(p); }
+	static void storeMask(float *p, const M m) { _mm256_storeu_ps(p, m); }
+
+	static I loadBits(const uint32_t *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+	static void storeBits(uint32_t *p, const I v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+	static I setBits(const uint32_t x) { return _mm256_set1_epi32(static_cast<int>(x)); }
+	static I addBits(const I a, const I b) { return _mm256_add_epi32(a, b); }
+	static I xorBits(const I a, const I b) { return _mm256_xor_si256(a, b); }
+	static I orBits(const I a, const I b) { return _mm256_or_si256(a, b); }
+	template <int N> static I shiftLeft(const I v) { return _mm256_slli_epi32(v, N); }
+	template <int N> static I shiftRight(const I v) { return _mm256_srli_epi32(v, N); }
+	static F asFloat(const I v) { return _mm256_castsi256_ps(v); }
+
+	static I truncate(const F v) { return _mm256_cvttps_epi32(v); }
+	static F toFloat(const I v) { return _mm256_cvtepi32_ps(v); }
+	static I nextIndex(const I v, const int32_t last) {
+		return _mm256_min_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(1)), _mm256_set1_epi32(last));
+	}
+	static F gather(const float *base, const I index, const M m) {
+		return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index, m, 4);
+	}
+};
+#endif
+
+#if defined(__AVX512F__)
+struct Vec16 {
+	typedef __m512 F;
+	typedef __mmask16 M;
+	typedef __m512i I;
+	enum { WIDTH = 16 };
+
+	static F load(const float *p) { return _mm512_loadu_ps(p); }
+	static void store(float *p, const F v) { _mm512_storeu_ps(p, v); }
+	static F set1(const float x) { return _mm512_set1_ps(x); }
+	static F ramp() {
+		return _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+							  8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+	}
+	static F add(const F a, const F b) { return _mm512_add_ps(a, b); }
+	static F sub(const F a, const F b) { return _mm512_sub_ps(a, b); }
+	static F mul(const F a, const F b) { return _mm512_mul_ps(a, b); }
+	static F min(const F a, const F b) { return _mm512_min_ps(a, b); }
+	static F max(const F a, const F b) { return _mm512_max_ps(a, b); }
+	static M greaterEqual(const F a, const F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OS); }
+	static M less(const F a, const F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OS); }
+	static M both(const M a, const M b) { return static_cast<M>(a & b); }
+	static M unless(const M a, const M b) { return static_cast<M>(a & ~b); }
+	static F select(const M m, const F a, const F b) { return _mm512_mask_blend_ps(m, b, a); }
+	static M loadMask(const float *p) {
+		const __m512i bits = _mm512_castps_si512(_mm512_loadu_ps(p));
+		return _mm512_test_epi32_mask(bits, bits);
+	}
+	static void storeMask(float *p, const M m) { _mm512_storeu_ps(p, _mm512_castsi512_ps(_mm512_maskz_set1_epi32(m, -1))); }
+
+	static I loadBits(const uint32_t *p) { return _mm512_loadu_si512(p); }
+	static void storeBits(uint32_t *p, const I v) { _mm512_storeu_si512(p, v); }
+	static I setBits(const uint32_t x) { return _mm512_set1_epi32(static_cast<int>(x)); }
+	static I addBits(const I a, const I b) { return _mm512_add_epi32(a, b); }
+	static I xorBits(const I a, const I b) { return _mm512_xor_si512(a, b); }
+	static I orBits(const I a, const I b) { return _mm512_or_si512(a, b); }
+	template <int N> static I shiftLeft(const I v) { return _mm512_slli_epi32(v, N); }
+	template <int N> static I shiftRight(const I v) { return _mm512_srli_epi32(v, N); }
+	static F asFloat(const I v) { return _mm512_castsi512_ps(v); }
+
+	static I truncate(const F v) { return _mm512_cvttps_epi32(v); }
+	static F toFloat(const I v) { return _mm512_cvtepi32_ps(v); }
+	static I nextIndex(const I v, const int32_t last) {
+		return _mm512_min_epi32(_mm512_add_epi32(v, _mm512_set1_epi32(1)), _mm512_set1_epi32(last));
+	}
+	static F gather(const float *base, const I index, const M m) {
+		return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, index, base, 4);
+	}
+};
+#endif
+
+// Runs kernel.run<V>(i) for i in [0, n), with the widest vectors that fit first.
+template <typename Kernel>
+void forEachVector(const Kernel &kernel, const int n) {
+	int i = 0;
+#if defined(__AVX512F__)
+	for (; i + Vec16::WIDTH <= n; i += Vec16::WIDTH) kernel.template run<Vec16>(i);
+#endif
+#if defined(__AVX2__)
+	for (; i + Vec8::WIDTH <= n; i += Vec8::WIDTH) kernel.template run<Vec8>(i);
+#endif
+#if defined(__SSE2__)
+	for (; i + Vec4::WIDTH <= n; i += Vec4::WIDTH) kernel.template run<Vec4>(i);
+#endif
+	for (; i < n; i++) kernel.template run<Vec1>(i);
+}
+
+// Same convolution as rack::dsp::Decimator::process(), lanes side by side.
+struct DecimateKernel {
+	const DecimatorLanes *decimator;
+	int taps;
+	float *out;
+
+	template <typename V>
+	void run(const int lane) const {
+		typename V::F sum = V::set1(0.0f);
+		for (int i = 0; i < taps; i++) {
+			const int index = (decimator->index - 1 - i + taps) % taps;
+			sum = V::add(sum, V::mul(V::set1(decimator->kernel[i]), V::load(&decimator->history[index][lane])));
+		}
+		V::store(out + lane, sum);
+	}
+};
+
+// Frames starting at `frame`, as AudioPlayer::play() computes them one by one.
+struct InterpolateKernel {
+	const float *samples;
+	float total;
+	int32_t last;
+	const float *positions;
+	float channel;
+	float gain;
+	float *out;
+
+	template <typename V>
+	void run(const int frame) const {
+		const typename V::F position = V::add(V::load(positions + frame), V::set1(channel));
+		const typename V::M valid = V::less(position, V::set1(total));
+		const typename V::I index = V::truncate(position);
+		const typename V::F delta = V::sub(position, V::toFloat(index));
+		const typename V::F a = V::gather(samples, index, valid);
+		const typename V::F b = V::gather(samples, V::nextIndex(index, last), valid);
+		const typename V::F sample = V::select(valid, V::add(a, V::mul(V::sub(b, a), delta)), V::set1(0.0f));
+		V::store(out + frame, V::mul(sample, V::set1(gain)));
+	}
+};
+
+struct CrossfadeKernel {
+	float *incoming;
+	const float *outgoing;
+	float step;
+	float in0, in1, out0, out1;
+
+	template <typename V>
+	void run(const int frame) const {
+		const typename V::F t = V::mul(V::add(V::ramp(), V::set1(static_cast<float>(frame))), V::set1(step));
+		const typename V::F gainIn = V::add(V::set1(in0), V::mul(V::set1(in1 - in0), t));
+		const typename V::F gainOut = V::add(V::set1(out0), V::mul(V::set1(out1 - out0), t));
+		const typename V::F mix = V::add(V::mul(V::load(incoming + frame), gainIn), V::mul(V::load(outgoing + frame), gainOut));
+		V::store(incoming + frame, mix);
+	}
+};
+
+// xoshiro128+ per lane, then the colour filter.
+struct NoiseKernel {
+	NoiseLanes *state;
+	float *out;
+	int frames;
+	int colour;
+
+	template <typename V>
+	void run(const int lane) const {
+		typedef typename V::F F;
+		typedef typename V::I I;
+
+		I s0 = V::loadBits(state->s0 + lane);
+		I s1 = V::loadBits(state->s1 + lane);
+		I s2 = V::loadBits(state->s2 + lane);
+		I s3 = V::loadBits(state->s3 + lane);
+		F pink0 = V::load(state->pink0 + lane);
+		F pink1 = V::load(state->pink1 + lane);
+		F pink2 = V::load(state->pink2 + lane);
+		F brown = V::load(state->brown + lane);
+
+		for (int i = 0; i < frames; i++) {
+			const I result = V::addBits(s0, s3);
+			const I t = V::template shiftLeft<9>(s1);
+
+			s2 = V::xorBits(s2, s0);
+			s3 = V::xorBits(s3, s1);
+			s1 = V::xorBits(s1, s2);
+			s0 = V::xorBits(s0, s3);
+			s2 = V::xorBits(s2, t);
+			s3 = V::orBits(V::template shiftLeft<11>(s3), V::template shiftRight<21>(s3));
+
+			// Upper 23 bits as mantissa of a float in [1, 2).
+			const F uniform = V::sub(V::asFloat(V::orBits(V::template shiftRight<9>(result), V::setBits(0x3f800000))), V::set1(1.0f));
+			const F white = V::sub(V::mul(uniform, V::set1(2.0f)), V::set1(1.0f));
+
+			F value;
+			switch (colour) {
+				case noise::PINK: {
+					// Paul Kellet's economy pink noise filter (-3dB/octave above ~10Hz at 44.1kHz).
+					pink0 = V::add(V::mul(V::set1(0.99765f), pink0), V::mul(white, V::set1(0.0990460f)));
+					pink1 = V::add(V::mul(V::set1(0.96300f), pink1), V::mul(white, V::set1(0.2965164f)));
+					pink2 = V::add(V::mul(V::set1(0.57000f), pink2), V::mul(white, V::set1(1.0526913f)));
+					const F sum = V::add(V::add(V::add(pink0, pink1), pink2), V::mul(white, V::set1(0.1848f)));
+					value = V::min(V::max(V::mul(sum, V::set1(0.18f)), V::set1(-1.0f)), V::set1(1.0f));
+				} break;
+				case noise::BROWN: {
+					// Leaky integrator (-6dB/octave).
+					brown = V::mul(V::add(brown, V::mul(white, V::set1(0.02f))), V::set1(1.0f / 1.02f));
+					value = V::min(V::max(V::mul(brown, V::set1(5.0f)), V::set1(-1.0f)), V::set1(1.0f));
+				} break;
+				default: {
+					value = white;
+				} break;
+			}
+			V::store(out + i * BLOCK_LANES + lane, value);
+		}
+
+		V::storeBits(state->s0 + lane, s0);
+		V::storeBits(state->s1 + lane, s1);
+		V::storeBits(state->s2 + lane, s2);
+		V::storeBits(state->s3 + lane, s3);
+		V::store(state->pink0 + lane, pink0);
+		V::store(state->pink1 + lane, pink1);
+		V::store(state->pink2 + lane, pink2);
+		V::store(state->brown + lane, brown);
+	}
+};
+
+// Internal clock (as Clock4::processInternal()) and iteration of the maps.
+struct LogisticOscillatorKernel {
+	LogisticLanes *maps;
+	const float *r;
+	float resetX;
+	float deltaPhase;
+	bool interpolate;
+	int frames;
+	float *out;
+
+	template <typename V>
+	void run(const int lane) const {
+		typedef typename V::F F;
+		typedef typename V::M M;
+
+		F x = V::load(maps->x + lane);
+		F lastX = V::load(maps->lastX + lane);
+		F phase = V::load(maps->phase + lane);
+		M reset = V::loadMask(maps->reset + lane);
+		const F laneR = V::load(r + lane);
+		const F one = V::set1(1.0f);
+
+		for (int i = 0; i < frames; i++) {
+			phase = V::add(phase, V::set1(deltaPhase));
+			const M step = V::greaterEqual(phase, one);
+			phase = V::select(step, V::sub(phase, one), phase);
+
+			lastX = V::select(step, x, lastX);
+			x = V::select(V::both(step, reset), V::set1(resetX), x);
+			reset = V::unless(reset, step);
+			// Don't let population die!
+			const F next = V::min(V::max(V::mul(V::mul(laneR, x), V::sub(one, x)), V::set1(0.00001f)), one);
+			x = V::select(step, next, x);
+
+			V::store(out + i * BLOCK_LANES + lane, interpolate ? V::add(lastX, V::mul(V::sub(x, lastX), phase)) : x);
+		}
+
+		V::store(maps->x + lane, x);
+		V::store(maps->lastX + lane, lastX);
+		V::store(maps->phase + lane, phase);
+		V::storeMask(maps->reset + lane, reset);
+	}
+};
+
+} // namespace
+
+
+void decimate(DecimatorLanes &decimator, const float *in, const int lanes, float *out) {
+	const int taps = decimator.oversample * DECIMATOR_QUALITY;
+	for (int k = 0; k < decimator.oversample; k++) {
+		for (int lane = 0; lane < lanes; lane++) {
+			decimator.history[decimator.index + k][lane] = in[k * BLOCK_LANES + lane];
+		}
+	}
+	decimator.index = (decimator.index + decimator.oversample) % taps;
+
+	const DecimateKernel kernel = {&decimator, taps, out};
+	forEachVector(kernel, lanes);
+}
+
+void interpolate(const float *samples, const uint64_t totalSamples, const float *positions, const int frames,
+				 const unsigned int channel, const float gain, float *out) {
+	const InterpolateKernel kernel = {samples, static_cast<float>(totalSamples), static_cast<int32_t>(totalSamples - 1),
+		positions, static_cast<float>(channel), gain, out};
+	forEachVector(kernel, frames);
+}
+
+void crossfadeMix(float *incoming, const float *outgoing, const int frames,
+				  const float in0, const float in1, const float out0, const float out1) {
+	const CrossfadeKernel kernel = {incoming, outgoing, 1.0f / frames, in0, in1, out0, out1};
+	forEachVector(kernel, frames);
+}
+
+void noise(NoiseLanes &state, float *out, const int frames, const int lanes, const int colour) {
+	const NoiseKernel kernel = {&state, out, frames, colour};
+	forEachVector(kernel, lanes);
+}
+
+void logisticOscillator(LogisticLanes &maps, const float *r, const float resetX, const float deltaPhase,
+						const bool interpolate, const int lanes, const int frames, float *out) {
+	const LogisticOscillatorKernel kernel = {&maps, r, resetX, deltaPhase, interpolate, frames, out};
+	forEachVector(kernel, lanes);
+}
+
+} // namespace BLOCK_KERNELS_NAMESPACE
+} // namespace block
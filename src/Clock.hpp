@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+
+#include "rack.hpp"
+
+#define CLOCK_NUM_RATIOS 9
+#define CLOCK_DEFAULT_RATIO 4 // Index of 1:1 in the ratio table
+
+
+// Clocks for 4 channels, internal or external, with sub-sample step times.
+//
+// The internal clock keeps the fractional phase on steps, so its tempo doesn't
+// depend on the sample rate. External clock edges are timed by interpolating
+// the threshold crossing between samples. External clocks can be divided and
+// multiplied; multiplied steps are spread over the measured clock period.
+//
+// Both return the lanes that step and, in `offset`, when each step happened
+// relative to the current sample (-1 < offset <= 0). When no lane steps, a
+// sample costs only a few vector operations.
+struct Clock4 {
+
+	Clock4() {
+		reset();
+	}
+
+	void reset() {
+		phase = 0.0f;
+		lastClock = 0.0f;
+		sinceEdge = -1e9f; // No period known yet
+		period = 0.0f;
+		edgeCount = 1e9f; // First edge steps
+		multiplyPhase = 0.0f;
+		multiplyRate = 0.0f;
+		multiplySteps = 0.0f;
+		trigger.reset();
+	}
+
+	rack::simd::float_4 processInternal(const float deltaPhase, rack::simd::float_4 &offset) {
+		using namespace rack::simd;
+
+		offset = 0.0f;
+		phase += deltaPhase;
+		const float_4 step = (phase >= 1.0f);
+		if (!movemask(step)) {
+			return step;
+		}
+
+		offset = clamp(-(phase - 1.0f) / deltaPhase, -0.9999f, 0.0f);
+		phase = ifelse(step, phase - 1.0f, phase);
+		return step;
+	}
+
+	rack::simd::float_4 processExternal(const rack::simd::float_4 clock, const int multiply, const int divide,
+		rack::simd::float_4 &offset) {
+		using namespace rack::simd;
+
+		offset = 0.0f;
+		const float_4 edge = trigger.process(clock);
+		const float_4 lastClockValue = lastClock;
+		lastClock = clock;
+		sinceEdge += 1.0f;
+
+		float_4 step = float_4::zero();
+		if (movemask(edge)) {
+			// Where the clock crossed the trigger threshold since the last sample.
+			const float_4 delta = clock - lastClockValue;
+			const float_4 edgeOffset = clamp(ifelse(delta > 0.0f, -(clock - 1.0f) / delta, 0.0f), -0.9999f, 0.0f);
+
+			period = ifelse(edge, sinceEdge + edgeOffset, period);
+			sinceEdge = ifelse(edge, -edgeOffset, sinceEdge);
+
+			edgeCount = ifelse(edge, edgeCount + 1.0f, edgeCount);
+			step = edge & (edgeCount >= static_cast<float>(divide));
+			edgeCount = ifelse(step, 0.0f, edgeCount);
+			offset = edgeOffset;
+
+			// The internal clock restarts with external steps.
+			phase = ifelse(step, 0.0f, phase);
+
+			if (multiply > 1) {
+				// Restart the multiplied clock at the edge, once the period is known.
+				const float_4 known = step & (period > 0.0f);
+				const float_4 rate = fmin(static_cast<float>(multiply) / (period * static_cast<float>(divide)), 0.5f);
+				multiplyRate = ifelse(known, rate, multiplyRate);
+				multiplyPhase = ifelse(known, -edgeOffset * rate, multiplyPhase);
+				multiplySteps = ifelse(known, multiply - 1.0f, ifelse(step, 0.0f, multiplySteps));
+			}
+		}
+
+		if (multiply > 1 && movemask(multiplySteps > 0.0f)) {
+			// Multiplied steps between edges. Never more than multiply - 1 per step,
+			// so a slowing clock doesn't produce extra steps.
+			multiplyPhase = ifelse(step, multiplyPhase, multiplyPhase + multiplyRate);
+			const float_4 multiplyStep = (multiplyPhase >= 1.0f) & (multiplySteps > 0.0f) & ~step;
+			if (movemask(multiplyStep)) {
+				offset = ifelse(multiplyStep, clamp(-(multiplyPhase - 1.0f) / multiplyRate, -0.9999f, 0.0f), offset);
+				multiplyPhase = ifelse(multiplyStep, multiplyPhase - 1.0f, multiplyPhase);
+				multiplySteps = ifelse(multiplyStep, multiplySteps - 1.0f, multiplySteps);
+				step = step | multiplyStep;
+			}
+		}
+
+		return step;
+	}
+
+	// Restarts the internal clock in lanes with a rising edge (hard sync). Returns these lanes.
+	rack::simd::float_4 sync(const rack::simd::float_4 clock) {
+		const rack::simd::float_4 edge = trigger.process(clock);
+		phase = rack::simd::ifelse(edge, 0.0f, phase);
+		lastClock = clock;
+		return edge;
+	}
+
+	// Internal clock phase in [0, 1).
+	rack::simd::float_4 getPhase() const {
+		return phase;
+	}
+
+private:
+
+	rack::dsp::TSchmittTrigger<rack::simd::float_4> trigger;
+
+	rack::simd::float_4 phase;
+	rack::simd::float_4 lastClock;
+
+	// External clock, in samples
+	rack::simd::float_4 sinceEdge;
+	rack::simd::float_4 period;
+	rack::simd::float_4 edgeCount;
+
+	// Multiplied external clock
+	rack::simd::float_4 multiplyPhase;
+	rack::simd::float_4 multiplyRate;
+	rack::simd::float_4 multiplySteps;
+
+};
+
+
+// Divide/multiply setting for external clocks.
+struct ClockRatio {
+
+	ClockRatio() :
+	  index(CLOCK_DEFAULT_RATIO)
+	  {}
+
+	// May be called from the UI thread.
+	void setIndex(const int newIndex) {
+		index = rack::math::clamp(newIndex, 0, CLOCK_NUM_RATIOS - 1);
+	}
+
+	int getIndex() const {
+		return index;
+	}
+
+	// Divider and multiplier of the current setting, read together.
+	void get(int &multiply, int &divide) const {
+		static const int ratios[CLOCK_NUM_RATIOS][2] = {
+			{1, 8}, {1, 4}, {1, 3}, {1, 2}, {1, 1}, {2, 1}, {3, 1}, {4, 1}, {8, 1}
+		};
+		const int i = index;
+		multiply = ratios[i][0];
+		divide = ratios[i][1];
+	}
+
+	json_t *toJson() const {
+		return json_integer(index);
+	}
+
+	void fromJson(json_t *indexJ) {
+		if (indexJ) setIndex(json_integer_value(indexJ));
+	}
+
+private:
+
+	std::atomic<int> index;
+
+};
+
+
+// Context menu entry for selecting the external clock ratio of a module.
+inline rack::ui::MenuItem *createClockRatioMenuItem(ClockRatio *clockRatio) {
+	return rack::createIndexSubmenuItem("External clock",
+		{"/8", "/4", "/3", "/2", "x1", "x2", "x3", "x4", "x8"},
+		[=]() { return clockRatio->getIndex(); },
+		[=](size_t index) { clockRatio->setIndex(index); });
+}
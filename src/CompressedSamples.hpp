@@ -0,0 +1,390 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+
+// Lossless in-memory compression of interleaved float samples.
+//
+// Samples are split into blocks that can be decoded independently. Blocks
+// whose samples are integer PCM values at a power-of-two scale (as produced
+// by 16/24 bit WAV and RAW files) are stored as per-channel deltas, bit-packed
+// to the width of the largest delta. Anything else is stored verbatim.
+struct CompressedSamples {
+
+	// Number of (interleaved) samples per block.
+	static const size_t BLOCK_SIZE = 4096;
+
+	struct Block {
+		uint32_t offset;   // First word of the block in `data`
+		uint8_t bits;      // Bits per packed value (32 for verbatim blocks)
+		uint8_t integer;   // Delta coded integer samples?
+		float scale;       // Integer scale, samples are value / scale
+	};
+
+	std::vector<Block> blocks;
+	std::vector<uint32_t> data;
+	size_t totalSamples = 0;
+	unsigned int channels = 1;
+
+	void clear() {
+		blocks.clear();
+		data.clear();
+		totalSamples = 0;
+	}
+
+	bool empty() const {
+		return blocks.empty();
+	}
+
+	size_t numBlocks() const {
+		return blocks.size();
+	}
+
+	size_t blockLength(const size_t block) const {
+		const size_t remaining = totalSamples - block * BLOCK_SIZE;
+		return (remaining < BLOCK_SIZE) ? remaining : BLOCK_SIZE;
+	}
+
+	size_t memoryUsage() const {
+		return blocks.size() * sizeof(Block) + data.size() * sizeof(uint32_t);
+	}
+
+	void encode(const float *samples, const size_t numSamples, const unsigned int numChannels) {
+		clear();
+		totalSamples = numSamples;
+		channels = numChannels;
+
+		const size_t count = (numSamples + BLOCK_SIZE - 1) / BLOCK_SIZE;
+		blocks.reserve(count);
+
+		for (size_t b = 0; b < count; ++b) {
+			const float *in = samples + b * BLOCK_SIZE;
+			const size_t length = blockLength(b);
+
+			Block block;
+			block.offset = static_cast<uint32_t>(data.size());
+			block.scale = integerScale(in, length);
+			block.integer = (block.scale > 0.0f);
+
+			if (block.integer) {
+				// Widest zigzag-coded delta determines the packed width.
+				uint32_t maxValue = 0;
+				for (size_t i = 0; i < length; ++i) {
+					maxValue |= zigzag(delta(in, i, block.scale));
+				}
+				block.bits = 1;
+				while (block.bits < 32 && (maxValue >> block.bits) != 0) {
+					block.bits++;
+				}
+
+				uint64_t acc = 0;
+				unsigned int accBits = 0;
+				for (size_t i = 0; i < length; ++i) {
+					acc |= static_cast<uint64_t>(zigzag(delta(in, i, block.scale))) << accBits;
+					accBits += block.bits;
+					if (accBits >= 32) {
+						data.push_back(static_cast<uint32_t>(acc));
+						acc >>= 32;
+						accBits -= 32;
+					}
+				}
+				if (accBits > 0) {
+					data.push_back(static_cast<uint32_t>(acc));
+				}
+			} else {
+				block.bits = 32;
+				block.scale = 1.0f;
+				const size_t offset = data.size();
+				data.resize(offset + length);
+				std::memcpy(&data[offset], in, length * sizeof(float));
+			}
+
+			blocks.push_back(block);
+		}
+
+		data.shrink_to_fit();
+	}
+
+	// Decode `block` into `out`, which must hold `blockLength(block)` samples.
+	void decodeBlock(const size_t block, float *out) const {
+		const Block &header = blocks[block];
+		const size_t length = blockLength(block);
+		const uint32_t *in = &data[header.offset];
+
+		if (!header.integer) {
+			std::memcpy(out, in, length * sizeof(float));
+			return;
+		}
+
+		const float invScale = 1.0f / header.scale;
+		const uint64_t mask = (header.bits < 32) ? ((1ull << header.bits) - 1) : 0xffffffffull;
+
+		uint64_t acc = 0;
+		unsigned int accBits = 0;
+		for (size_t i = 0; i < length; ++i) {
+			if (accBits < header.bits) {
+				acc |= static_cast<uint64_t>(*in++) << accBits;
+				accBits += 32;
+			}
+			const uint32_t value = static_cast<uint32_t>(acc & mask);
+			acc >>= header.bits;
+			accBits -= header.bits;
+
+			// Predict from the previous sample of the same channel. Integer
+			// values at a power-of-two scale round-trip exactly through float.
+			const int32_t prev = (i >= channels) ? static_cast<int32_t>(out[i - channels] * header.scale) : 0;
+			out[i] = static_cast<float>(unzigzag(value) + prev) * invScale;
+		}
+	}
+
+private:
+
+	// Largest integer magnitude exactly representable in a float.
+	static constexpr float MAX_INTEGER = 16777216.0f;
+
+	// Smallest power-of-two scale that turns all samples into integers
+	// (RAW, 16 bit and 24 bit PCM), or 0 if there is none.
+	static float integerScale(const float *in, const size_t length) {
+		const float scales[] = {1.0f, 32768.0f, 8388608.0f};
+		for (const float scale : scales) {
+			bool exact = true;
+			for (size_t i = 0; i < length && exact; ++i) {
+				const float value = in[i] * scale;
+				exact = (std::fabs(value) < MAX_INTEGER) && (value == std::nearbyint(value));
+			}
+			if (exact) {
+				return scale;
+			}
+		}
+		return 0.0f;
+	}
+
+	int32_t delta(const float *in, const size_t i, const float scale) const {
+		const int32_t value = static_cast<int32_t>(in[i] * scale);
+		const int32_t prev = (i >= channels) ? static_cast<int32_t>(in[i - channels] * scale) : 0;
+		return value - prev;
+	}
+
+	static uint32_t zigzag(const int32_t value) {
+		return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	}
+
+	static int32_t unzigzag(const uint32_t value) {
+		return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+	}
+};
+
+
+// Small cache of decoded blocks of a CompressedSamples object, owned by a
+// single player. The engine thread requests the blocks it needs next and a
+// decoder thread decodes them. A block that isn't decoded in time (e.g. after
+// a jump) is decoded on the engine thread and counts as a miss, so the output
+// never depends on decoder timing. That costs at most BLOCK_SIZE samples.
+//
+// A slot belongs to the engine while FREE or READY and to the decoder while
+// REQUESTED or DECODING. Each request is tagged with the cache generation, so
+// blocks decoded for a previous source are never played.
+struct SampleBlockCache {
+
+	static const int NUM_SLOTS = 4;
+	static const int PREFETCH_BLOCKS = 2; // Ahead of the play position
+
+	enum SlotState {
+		FREE,
+		REQUESTED,
+		DECODING,
+		READY
+	};
+
+	// Engine thread
+	void reset(const CompressedSamples *samples) {
+		source = samples;
+		generation++;
+		lastBlock = NO_BLOCK;
+		lastData = nullptr;
+		for (int i = 0; i < NUM_SLOTS; ++i) {
+			int expected = REQUESTED;
+			slots[i].state.compare_exchange_strong(expected, FREE);
+		}
+	}
+
+	// Engine thread. Sample `index` (< source->totalSamples).
+	float get(const size_t index) {
+		const size_t block = index / CompressedSamples::BLOCK_SIZE;
+		if (block != lastBlock) {
+			const int slot = find(block);
+			if (slot >= 0 && slots[slot].state.load(std::memory_order_acquire) == READY) {
+				lastSlot = slot;
+				lastData = slots[slot].data;
+			} else {
+				decodeNow(block);
+			}
+			lastBlock = block;
+		}
+		return lastData[index % CompressedSamples::BLOCK_SIZE];
+	}
+
+	// Engine thread. Requests the block of sample `index` and the ones after
+	// it. Past the end, playback continues at `loopIndex`.
+	void prefetch(const size_t index, const size_t loopIndex) {
+		if (!source || source->numBlocks() == 0) {
+			return;
+		}
+		size_t block = index / CompressedSamples::BLOCK_SIZE;
+		for (int i = 0; i <= PREFETCH_BLOCKS; ++i) {
+			if (block >= source->numBlocks()) {
+				block = std::min(loopIndex / CompressedSamples::BLOCK_SIZE, source->numBlocks() - 1);
+			}
+			request(block);
+			block++;
+		}
+	}
+
+	// Engine thread. Returns and clears the misses (blocks decoded on the engine
+	// thread) and whether blocks were requested.
+	unsigned long takeMisses() {
+		const unsigned long n = misses;
+		misses = 0;
+		return n;
+	}
+	bool takeRequests() {
+		const bool requested = pendingRequests;
+		pendingRequests = false;
+		return requested;
+	}
+
+	// Decoder thread. Decodes all requested blocks and returns their number.
+	// Sources must stay alive until it returns.
+	int decode() {
+		int count = 0;
+		for (int i = 0; i < NUM_SLOTS; ++i) {
+			Slot &slot = slots[i];
+			int expected = REQUESTED;
+			if (slot.state.compare_exchange_strong(expected, DECODING, std::memory_order_acquire)) {
+				slot.source->decodeBlock(slot.block, slot.data);
+				slot.state.store(READY, std::memory_order_release);
+				count++;
+			}
+		}
+		return count;
+	}
+
+private:
+
+	static const size_t NO_BLOCK = ~static_cast<size_t>(0);
+
+	struct Slot {
+		std::atomic<int> state{FREE};
+		size_t block = NO_BLOCK;
+		const CompressedSamples *source = nullptr;
+		uint32_t generation = 0;
+		unsigned long lastUse = 0;
+		float data[CompressedSamples::BLOCK_SIZE];
+	};
+
+	// Decodes a block that isn't ready on the engine thread: into its slot if
+	// the decoder hasn't started on it, else into a free slot. While the decoder
+	// is busy with all slots, into a buffer of the engine.
+	void decodeNow(const size_t block) {
+		misses++;
+
+		int slot = find(block);
+		int expected = REQUESTED;
+		if (slot >= 0 && !slots[slot].state.compare_exchange_strong(expected, DECODING, std::memory_order_acquire)) {
+			slot = -1; // Being decoded
+		}
+		else if (slot < 0) {
+			slot = victim();
+			if (slot >= 0) {
+				assign(slots[slot], block);
+			}
+		}
+
+		if (slot < 0) {
+			source->decodeBlock(block, fallback);
+			lastSlot = -1;
+			lastData = fallback;
+			return;
+		}
+
+		source->decodeBlock(block, slots[slot].data);
+		slots[slot].state.store(READY, std::memory_order_release);
+		lastSlot = slot;
+		lastData = slots[slot].data;
+	}
+
+	// Slot requested for `block` in this generation, or -1.
+	int find(const size_t block) const {
+		for (int i = 0; i < NUM_SLOTS; ++i) {
+			const int state = slots[i].state.load(std::memory_order_acquire);
+			if (state != FREE && slots[i].block == block && slots[i].generation == generation) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	void request(const size_t block) {
+		useCounter++;
+
+		const int found = find(block);
+		if (found >= 0) {
+			slots[found].lastUse = useCounter;
+			return;
+		}
+
+		const int slot = victim();
+		if (slot < 0) {
+			return;
+		}
+		assign(slots[slot], block);
+		slots[slot].state.store(REQUESTED, std::memory_order_release);
+		pendingRequests = true;
+	}
+
+	// Least recently used slot the decoder isn't working on, or -1. Blocks of
+	// previous generations go first.
+	int victim() const {
+		int slot = -1;
+		for (int i = 0; i < NUM_SLOTS; ++i) {
+			const int state = slots[i].state.load(std::memory_order_acquire);
+			if (state == REQUESTED || state == DECODING) {
+				continue;
+			}
+			if (state == FREE || slots[i].generation != generation) {
+				return i;
+			}
+			if (slot < 0 || slots[i].lastUse < slots[slot].lastUse) {
+				slot = i;
+			}
+		}
+		return slot;
+	}
+
+	// Reuses a slot the engine owns for `block` of the current source.
+	void assign(Slot &slot, const size_t block) {
+		if (lastSlot >= 0 && &slot == &slots[lastSlot]) {
+			lastBlock = NO_BLOCK;
+		}
+		slot.block = block;
+		slot.source = source;
+		slot.generation = generation;
+		slot.lastUse = useCounter;
+	}
+
+	Slot slots[NUM_SLOTS];
+	const CompressedSamples *source = nullptr;
+	uint32_t generation = 0;
+	size_t lastBlock = NO_BLOCK;
+	int lastSlot = -1;
+	const float *lastData = nullptr;
+	float fallback[CompressedSamples::BLOCK_SIZE];
+	unsigned long useCounter = 0;
+	unsigned long misses = 0;
+	bool pendingRequests = false;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+
+#include "rack.hpp"
+
+#define CONTROL_RATE_DEFAULT_DIVISION 16
+
+
+// Divides the engine sample rate down to a control rate. Knobs and CV that
+// don't need audio rate are read, and lights are updated, only on control
+// frames. Triggers, clocks and audio inputs stay at audio rate.
+struct ControlRate {
+
+	ControlRate() :
+	  division(CONTROL_RATE_DEFAULT_DIVISION),
+	  counter(0)
+	  {}
+
+	// True on control frames. The first call after a reset is always one.
+	bool process() {
+		if (counter > 0) {
+			counter--;
+			return false;
+		}
+		counter = division - 1;
+		return true;
+	}
+
+	void reset() {
+		counter = 0;
+	}
+
+	// Time between two control frames.
+	float sampleTime(const rack::engine::Module::ProcessArgs &args) const {
+		return args.sampleTime * division;
+	}
+
+	// May be called from the UI thread. Takes effect with the next control frame.
+	void setDivision(const int newDivision) {
+		division = rack::math::clamp(newDivision, 1, 256);
+	}
+
+	int getDivision() const {
+		return division;
+	}
+
+	json_t *toJson() const {
+		return json_integer(division);
+	}
+
+	void fromJson(json_t *divisionJ) {
+		if (divisionJ) setDivision(json_integer_value(divisionJ));
+	}
+
+private:
+
+	std::atomic<int> division;
+	int counter;
+
+};
+
+
+// Context menu entry for selecting the control rate of a module.
+inline rack::ui::MenuItem *createControlRateMenuItem(ControlRate *controlRate) {
+	static const int divisions[] = {1, 4, 16, 64};
+	return rack::createIndexSubmenuItem("Control rate",
+		{"Audio rate", "1/4 audio rate", "1/16 audio rate", "1/64 audio rate"},
+		[=]() {
+			size_t index = 0;
+			for (size_t i = 0; i < sizeof(divisions) / sizeof(divisions[0]); i++) {
+				if (divisions[i] <= controlRate->getDivision()) index = i;
+			}
+			return index;
+		},
+		[=](size_t index) {
+			controlRate->setDivision(divisions[index]);
+		});
+}
@@ -0,0 +1,83 @@
+#include "Cpu.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "rack.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86
+#endif
+
+
+namespace cpu {
+
+namespace {
+
+Isa best() {
+	for (int isa = NUM_ISAS - 1; isa > BASELINE_ISA; isa--) {
+		if (supported(static_cast<Isa>(isa))) {
+			return static_cast<Isa>(isa);
+		}
+	}
+	return BASELINE_ISA;
+}
+
+Isa select() {
+	const Isa isa = best();
+
+	const char *override = std::getenv(CPU_ISA_ENV);
+	if (!override || !*override) {
+		return isa;
+	}
+	for (int i = 0; i < NUM_ISAS; i++) {
+		if (strcasecmp(override, name(static_cast<Isa>(i))) == 0) {
+			if (supported(static_cast<Isa>(i))) {
+				return static_cast<Isa>(i);
+			}
+			WARN("%s=%s is not supported by this CPU, using %s", CPU_ISA_ENV, override, name(isa));
+			return isa;
+		}
+	}
+	WARN("Unknown %s=%s, using %s", CPU_ISA_ENV, override, name(isa));
+	return isa;
+}
+
+} // namespace
+
+
+bool supported(const Isa isa) {
+	switch (isa) {
+		case BASELINE_ISA: return true;
+#ifdef CPU_X86
+		case AVX2_ISA: {
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		}
+		case AVX512_ISA: {
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx512f");
+		}
+#endif
+		default: return false;
+	}
+}
+
+Isa selected() {
+	static const Isa isa = select();
+	return isa;
+}
+
+const char *name(const Isa isa) {
+	switch (isa) {
+		case AVX2_ISA: return "avx2";
+		case AVX512_ISA: return "avx512";
+		default: return "baseline";
+	}
+}
+
+void init() {
+	INFO("Using %s kernels (best supported: %s)", name(selected()), name(best()));
+}
+
+} // namespace cpu
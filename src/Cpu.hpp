@@ -0,0 +1,29 @@
+#pragma once
+
+#define CPU_ISA_ENV "MODULAR80_ISA" // Override: baseline, avx2 or avx512
+
+
+// Runtime selection of the instruction set for kernels built in several ISA
+// variants (see Makefile). The best variant the CPU supports is selected
+// once, unless overridden with the environment variable MODULAR80_ISA, e.g.
+// for A/B benchmarks of the same binary.
+namespace cpu {
+
+enum Isa {
+	BASELINE_ISA, // Build target of Rack: SSE4.2 on x64, NEON on ARM64
+	AVX2_ISA,     // AVX2 + FMA
+	AVX512_ISA,   // AVX-512F
+	NUM_ISAS
+};
+
+bool supported(const Isa isa);
+
+// Selected variant. Thread safe, detected on first use.
+Isa selected();
+
+const char *name(const Isa isa);
+
+// Selects and logs the variant (at plugin init).
+void init();
+
+} // namespace cpu
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+
+#include "rack.hpp"
+
+#include "BlockKernels.hpp"
+#include "FastMath.hpp"
+
+#define CROSSFADE_TABLE_SIZE 129
+#define CROSSFADE_DEFAULT_DURATION 0.025f // Seconds
+#define CROSSFADE_MIN_DURATION 0.001f
+#define CROSSFADE_MAX_DURATION 10.0f
+
+// Gain of the incoming signal over the fade, sin(0) .. sin(pi/2). The outgoing one mirrors it.
+static constexpr fastmath::Table<CROSSFADE_TABLE_SIZE> CROSSFADE_GAINS = fastmath::sinQuarterTable<CROSSFADE_TABLE_SIZE>();
+
+
+// Equal power crossfade of a configurable duration, applied block-wise.
+// Gains are looked up once per block and ramped linearly across it, so the
+// cost per frame doesn't depend on the duration of the fade.
+struct Crossfade {
+
+	Crossfade() :
+	  duration(CROSSFADE_DEFAULT_DURATION),
+	  phase(1.0f)
+	  {}
+
+	void start() {
+		phase = 0.0f;
+	}
+
+	void stop() {
+		phase = 1.0f;
+	}
+
+	bool isActive() const {
+		return phase < 1.0f;
+	}
+
+	// Mixes one block of the outgoing signal into the incoming one, in place,
+	// and advances the fade by the block. Channels are planar, the number of
+	// frames is a multiple of 4. sampleTime is that of the rendered signal.
+	void process(float *const *incoming, const float *const *outgoing, const int channels, const int frames,
+				 const float sampleTime, const float fadeDuration) {
+		const float end = std::min(phase + frames * sampleTime / fadeDuration, 1.0f);
+		const float in0 = gain(phase);
+		const float in1 = gain(end);
+		const float out0 = gain(1.0f - phase);
+		const float out1 = gain(1.0f - end);
+
+		for (int c = 0; c < channels; c++) {
+			block::crossfadeMix(incoming[c], outgoing[c], frames, in0, in1, out0, out1);
+		}
+
+		phase = end;
+	}
+
+	// May be called from the UI thread. Takes effect with the next block.
+	void setDuration(const float newDuration) {
+		duration = rack::math::clamp(newDuration, CROSSFADE_MIN_DURATION, CROSSFADE_MAX_DURATION);
+	}
+
+	float getDuration() const {
+		return duration;
+	}
+
+	json_t *toJson() const {
+		return json_real(duration);
+	}
+
+	void fromJson(json_t *durationJ) {
+		if (durationJ) setDuration(json_number_value(durationJ));
+	}
+
+private:
+
+	// Incoming gain at a position of the fade (0 .. 1).
+	static float gain(const float position) {
+		const float x = position * (CROSSFADE_TABLE_SIZE - 1);
+		const int i = std::min(static_cast<int>(x), CROSSFADE_TABLE_SIZE - 2);
+		return CROSSFADE_GAINS[i] + (CROSSFADE_GAINS[i + 1] - CROSSFADE_GAINS[i]) * (x - i);
+	}
+
+	std::atomic<float> duration;
+	float phase;
+
+};
+
+
+// Context menu entry for selecting the duration of a crossfade.
+inline rack::ui::MenuItem *createCrossfadeMenuItem(Crossfade *crossfade) {
+	static const float durations[] = {0.005f, 0.025f, 0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 5.0f};
+	return rack::createIndexSubmenuItem("Crossfade time",
+		{"5 ms", "25 ms", "100 ms", "250 ms", "500 ms", "1 s", "2 s", "5 s"},
+		[=]() {
+			size_t index = 0;
+			for (size_t i = 0; i < sizeof(durations) / sizeof(durations[0]); i++) {
+				if (durations[i] <= crossfade->getDuration()) index = i;
+			}
+			return index;
+		},
+		[=](size_t index) {
+			crossfade->setDuration(durations[index]);
+		});
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "rack.hpp"
+
+
+// Approximations for per-sample and per-block math, with bounded error.
+// Scalar and simd::float_4 versions give identical results.
+namespace fastmath {
+
+// Degree 5 polynomial for 2^f on [0, 1), fitted for minimum relative error.
+template <typename T>
+inline T exp2Fraction(const T f) {
+	T p = 1.867182902e-03f;
+	p = p * f + 9.016687982e-03f;
+	p = p * f + 5.580044538e-02f;
+	p = p * f + 2.401641607e-01f;
+	p = p * f + 6.931513548e-01f;
+	return p * f + 1.0f;
+}
+
+// 2^x. Max relative error vs. libm exp2: 2e-7 for x in [-126, 127].
+// Input is clamped to this range.
+inline float exp2(float x) {
+	x = rack::math::clamp(x, -126.0f, 127.0f);
+	const float xi = std::floor(x);
+	const float p = exp2Fraction(x - xi);
+
+	// Add integer part to the exponent bits.
+	int32_t bits;
+	std::memcpy(&bits, &p, sizeof(bits));
+	bits += static_cast<int32_t>(xi) * (1 << 23);
+
+	float y;
+	std::memcpy(&y, &bits, sizeof(y));
+	return y;
+}
+
+inline rack::simd::float_4 exp2(rack::simd::float_4 x) {
+	using namespace rack::simd;
+	x = clamp(x, -126.0f, 127.0f);
+	const float_4 xi = floor(x);
+	const float_4 p = exp2Fraction(x - xi);
+	const int32_4 exponent = int32_4(_mm_cvttps_epi32(xi.v)) << 23;
+	return float_4::cast(int32_4::cast(p) + exponent);
+}
+
+
+// Compile-time tables.
+template <size_t N>
+struct Table {
+	float values[N];
+
+	constexpr float operator[](const size_t i) const {
+		return values[i];
+	}
+};
+
+template <size_t... I>
+struct Indices {};
+
+template <size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeIndices<0, I...> {
+	typedef Indices<I...> type;
+};
+
+constexpr float ipow(const float base, const size_t n) {
+	return (n == 0) ? 1.0f : base * ipow(base, n - 1);
+}
+
+template <size_t... I>
+constexpr Table<sizeof...(I)> powTable(const float base, Indices<I...>) {
+	return {{ipow(base, I + 1)...}};
+}
+
+// base^1 .. base^N, e.g. the gains of an exponential decay over one block.
+// Each power rounds once more: max relative error of base^n is n * 6e-8.
+template <size_t N>
+constexpr Table<N> powTable(const float base) {
+	return powTable(base, typename MakeIndices<N>::type());
+}
+
+// sin(x) for x in [0, pi/2], Taylor series up to x^11. Max error 2e-7
+// (6e-8 from the series, the rest from float evaluation).
+constexpr float sinQuarter(const float x) {
+	return x * (1.0f - x * x / 6.0f * (1.0f - x * x / 20.0f * (1.0f - x * x / 42.0f *
+		(1.0f - x * x / 72.0f * (1.0f - x * x / 110.0f)))));
+}
+
+template <size_t... I>
+constexpr Table<sizeof...(I)> sinQuarterTable(Indices<I...>) {
+	return {{sinQuarter(1.57079633f * I / (sizeof...(I) - 1))...}};
+}
+
+// sin(0) .. sin(pi/2) in N - 1 equal steps, e.g. equal power fade gains.
+template <size_t N>
+constexpr Table<N> sinQuarterTable() {
+	return sinQuarterTable(typename MakeIndices<N>::type());
+}
+
+} // namespace fastmath
@@ -0,0 +1,386 @@
+#include "modular80.hpp"
+#include "InputCapture.hpp"
+
+#include <cstring>
+#include <ctime>
+
+#define INPUT_CAPTURE_MAGIC "M80CAP1"
+#define IDS_PER_INPUT (PORT_MAX_CHANNELS + 1)
+
+
+namespace {
+
+void writeVarint(uint8_t *&out, uint64_t value) {
+	while (value >= 0x80) {
+		*out++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+}
+
+bool readVarint(const std::vector<uint8_t> &data, size_t &pos, uint64_t &value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+		const uint8_t byte = data[pos++];
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void writeUint32(FILE *file, const uint32_t value) {
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+bool readBytes(const std::vector<uint8_t> &data, size_t &pos, void *out, const size_t size) {
+	if (pos + size > data.size()) {
+		return false;
+	}
+	std::memcpy(out, &data[pos], size);
+	pos += size;
+	return true;
+}
+
+uint32_t floatBits(const float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+} // namespace
+
+
+InputCapture::InputCapture() :
+  block(nullptr),
+  maxRecordSize(0),
+  lastFrame(0),
+  recording(false),
+  running(false),
+  done(true),
+  dropped(0),
+  file(nullptr)
+  {}
+
+InputCapture::~InputCapture() {
+	// The engine no longer processes the module. Write what has been recorded.
+	recording = false;
+	if (running) {
+		fullBlocks.push(std::move(block));
+		running = false;
+	}
+	done = true;
+	if (writer.joinable()) {
+		writer.join();
+	}
+}
+
+std::string InputCapture::createPath(const std::string &slug) {
+	const std::string dir = asset::user(INPUT_CAPTURE_DIR);
+	system::createDirectories(dir);
+
+	char timestamp[32];
+	const std::time_t now = std::time(nullptr);
+	std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+	return system::join(dir, slug + "-" + timestamp + ".m80cap");
+}
+
+bool InputCapture::start(rack::engine::Module *module, const std::string &slug, const std::string &path) {
+	if (recording || running) {
+		return false;
+	}
+	if (writer.joinable()) {
+		writer.join();
+	}
+
+	file = fopen(path.c_str(), "wb");
+	if (!file) {
+		WARN("Failed to create capture file %s", path.c_str());
+		return false;
+	}
+
+	if (blocks.empty()) {
+		blocks.resize(INPUT_CAPTURE_NUM_BLOCKS);
+		for (Block &b : blocks) {
+			b.size = 0;
+			freeBlocks.push(&b);
+		}
+	}
+
+	const int numParams = module->params.size();
+	const int numInputs = module->inputs.size();
+	const int numOutputs = module->outputs.size();
+	lastValues.assign(numParams + numInputs * IDS_PER_INPUT + numOutputs, 0);
+
+	// Every value of a frame: varint id (max 3 bytes) + float.
+	maxRecordSize = 10 + 2 + lastValues.size() * (3 + sizeof(float));
+
+	// Header
+	json_t *stateJ = module->dataToJson();
+	char *state = stateJ ? json_dumps(stateJ, JSON_COMPACT) : nullptr;
+	const std::string stateString = state ? state : "";
+	free(state);
+	if (stateJ) json_decref(stateJ);
+
+	const float sampleRate = APP->engine->getSampleRate();
+	fwrite(INPUT_CAPTURE_MAGIC, 1, 8, file);
+	fwrite(&sampleRate, sizeof(sampleRate), 1, file);
+	writeUint32(file, numParams);
+	writeUint32(file, numInputs);
+	writeUint32(file, numOutputs);
+	writeUint32(file, slug.size());
+	fwrite(slug.data(), 1, slug.size(), file);
+	writeUint32(file, stateString.size());
+	fwrite(stateString.data(), 1, stateString.size(), file);
+
+	INFO("Capturing inputs of %s to %s", slug.c_str(), path.c_str());
+
+	dropped = 0;
+	done = false;
+	writer = std::thread(&InputCapture::writerThread, this);
+	recording = true;
+	return true;
+}
+
+void InputCapture::stop() {
+	recording = false;
+}
+
+void InputCapture::capture(rack::engine::Module *module, const rack::engine::Module::ProcessArgs &args) {
+	if (!running) {
+		// Start with all values.
+		Block **b = freeBlocks.front();
+		if (!b) {
+			return;
+		}
+		block = *b;
+		freeBlocks.pop();
+
+		running = true;
+		lastFrame = args.frame;
+		writeRecord(module, args.frame, true);
+		return;
+	}
+
+	if (!recording) {
+		// End marker, then hand the last block to the writer.
+		if (block->size + 12 <= INPUT_CAPTURE_BLOCK_SIZE) {
+			uint8_t *out = block->data + block->size;
+			writeVarint(out, args.frame - lastFrame);
+			*out++ = 0;
+			*out++ = 0;
+			block->size = out - block->data;
+		}
+		fullBlocks.push(std::move(block));
+		block = nullptr;
+		running = false;
+		done = true;
+		return;
+	}
+
+	if (block->size + maxRecordSize > INPUT_CAPTURE_BLOCK_SIZE) {
+		Block **b = freeBlocks.front();
+		if (!b) {
+			// Writer is behind. Changes are recorded with the next frame that fits.
+			dropped++;
+			return;
+		}
+		fullBlocks.push(std::move(block));
+		block = *b;
+		freeBlocks.pop();
+	}
+
+	writeRecord(module, args.frame, false);
+}
+
+// Appends the values that changed since the last record (all values if `all`).
+bool InputCapture::writeRecord(rack::engine::Module *module, const int64_t frame, const bool all) {
+	uint8_t *start = block->data + block->size;
+	uint8_t *out = start;
+	writeVarint(out, frame - lastFrame);
+	uint8_t *countPos = out;
+	out += 2;
+
+	uint16_t count = 0;
+	size_t id = 0;
+	auto value = [&](const float v) {
+		const uint32_t bits = floatBits(v);
+		if (all || bits != lastValues[id]) {
+			lastValues[id] = bits;
+			writeVarint(out, id);
+			std::memcpy(out, &bits, sizeof(bits));
+			out += sizeof(bits);
+			count++;
+		}
+		id++;
+	};
+
+	for (rack::engine::Param &param : module->params) {
+		value(param.getValue());
+	}
+	for (rack::engine::Input &input : module->inputs) {
+		for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+			value(input.getVoltage(c));
+		}
+		value(input.getChannels());
+	}
+	for (rack::engine::Output &output : module->outputs) {
+		value(output.isConnected() ? 1.0f : 0.0f);
+	}
+
+	if (count == 0) {
+		return false;
+	}
+
+	std::memcpy(countPos, &count, sizeof(count));
+	block->size += out - start;
+	lastFrame = frame;
+	return true;
+}
+
+void InputCapture::writerThread() {
+	system::setThreadName("Input capture");
+
+	while (true) {
+		const bool finished = done;
+
+		Block **b = fullBlocks.front();
+		if (b) {
+			Block *full = *b;
+			fullBlocks.pop();
+			fwrite(full->data, 1, full->size, file);
+			full->size = 0;
+			freeBlocks.push(std::move(full));
+			continue;
+		}
+
+		if (finished) {
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+
+	fclose(file);
+	file = nullptr;
+
+	if (dropped > 0) {
+		WARN("Input capture dropped %llu records, disk too slow", (unsigned long long)dropped);
+	}
+}
+
+
+bool InputCaptureReader::open(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data.resize(ftell(file));
+	rewind(file);
+	const size_t bytesRead = fread(data.data(), 1, data.size(), file);
+	fclose(file);
+	if (bytesRead != data.size()) {
+		return false;
+	}
+
+	pos = 0;
+	char magic[8];
+	uint32_t params, inputs, outputs, length;
+	if (!readBytes(data, pos, magic, 8) || std::memcmp(magic, INPUT_CAPTURE_MAGIC, 8) != 0 ||
+		!readBytes(data, pos, &sampleRate, sizeof(sampleRate)) ||
+		!readBytes(data, pos, &params, 4) || !readBytes(data, pos, &inputs, 4) || !readBytes(data, pos, &outputs, 4)) {
+		return false;
+	}
+	numParams = params;
+	numInputs = inputs;
+	numOutputs = outputs;
+
+	if (!readBytes(data, pos, &length, 4) || pos + length > data.size()) {
+		return false;
+	}
+	slug.assign(reinterpret_cast<const char*>(&data[pos]), length);
+	pos += length;
+
+	if (!readBytes(data, pos, &length, 4) || pos + length > data.size()) {
+		return false;
+	}
+	state.assign(reinterpret_cast<const char*>(&data[pos]), length);
+	pos += length;
+
+	nextFrame = 0;
+	ended = false;
+	return readNextFrame();
+}
+
+bool InputCaptureReader::readNextFrame() {
+	uint64_t delta;
+	if (!readVarint(data, pos, delta)) {
+		ended = true; // Truncated capture
+		return false;
+	}
+	nextFrame += delta;
+	return true;
+}
+
+bool InputCaptureReader::apply(rack::engine::Module *module, const int64_t frame) {
+	while (!ended && frame == nextFrame) {
+		uint16_t count;
+		if (!readBytes(data, pos, &count, sizeof(count)) || count == 0) {
+			ended = true;
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			uint64_t id;
+			float value;
+			if (!readVarint(data, pos, id) || !readBytes(data, pos, &value, sizeof(value))) {
+				ended = true;
+				return false;
+			}
+
+			if (id < static_cast<uint64_t>(numParams)) {
+				if (id < module->params.size()) module->params[id].setValue(value);
+				continue;
+			}
+			id -= numParams;
+
+			if (id < static_cast<uint64_t>(numInputs * IDS_PER_INPUT)) {
+				const size_t input = id / IDS_PER_INPUT;
+				const int channel = id % IDS_PER_INPUT;
+				if (input >= module->inputs.size()) continue;
+				if (channel == PORT_MAX_CHANNELS) {
+					module->inputs[input].channels = value;
+				} else {
+					module->inputs[input].setVoltage(value, channel);
+				}
+				continue;
+			}
+			id -= numInputs * IDS_PER_INPUT;
+
+			// The module sets the number of channels of connected outputs.
+			if (id < module->outputs.size()) {
+				rack::engine::Output &output = module->outputs[id];
+				if (value == 0.0f) output.channels = 0;
+				else if (output.channels == 0) output.channels = 1;
+			}
+		}
+
+		readNextFrame();
+	}
+	return !ended;
+}
+
+
+rack::ui::MenuItem *createInputCaptureMenuItem(rack::engine::Module *module, InputCapture *capture) {
+	return createBoolMenuItem("Capture inputs", "",
+		[=]() { return capture->isRecording(); },
+		[=](bool enabled) {
+			if (enabled) {
+				const std::string slug = module->model ? module->model->slug : "Module";
+				capture->start(module, slug, InputCapture::createPath(slug));
+			} else {
+				capture->stop();
+			}
+		});
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rack.hpp"
+#include "SpscQueue.hpp"
+
+#define INPUT_CAPTURE_BLOCK_SIZE 65536
+#define INPUT_CAPTURE_NUM_BLOCKS 16
+#define INPUT_CAPTURE_DIR "modular80-captures" // In the Rack user folder
+
+
+// Records the params, input voltages and connected outputs of a module to a
+// compact binary file, so real patches can be replayed offline (see bench/).
+// Only changes are stored, values are bit exact.
+//
+// File format (little endian):
+//   header:  "M80CAP1\0", float sample rate, uint32 params, inputs, outputs,
+//            uint32 length + module slug, uint32 length + module state (JSON)
+//   records: varint frames since the previous record, uint16 count,
+//            count x (varint id, float32 value)
+//   ids:     params: p
+//            input i: params + i * 17 + channel (16 = number of channels)
+//            output o: params + inputs * 17 + o (1 = connected)
+// A record without values marks the end of the capture.
+class InputCapture {
+
+public:
+
+InputCapture();
+~InputCapture();
+
+// UI thread. Recording starts with the next process() call. Returns false
+// while a previous capture is still being finished.
+bool start(rack::engine::Module *module, const std::string &slug, const std::string &path);
+
+// UI thread. Recording stops with the next process() call.
+void stop();
+
+bool isRecording() const {
+	return recording;
+}
+
+// Engine thread. Call at the start of process().
+void process(rack::engine::Module *module, const rack::engine::Module::ProcessArgs &args) {
+	if (recording || running) {
+		capture(module, args);
+	}
+}
+
+// New file in the capture folder of the Rack user directory.
+static std::string createPath(const std::string &slug);
+
+private:
+
+struct Block {
+	size_t size;
+	uint8_t data[INPUT_CAPTURE_BLOCK_SIZE];
+};
+
+void capture(rack::engine::Module *module, const rack::engine::Module::ProcessArgs &args);
+bool writeRecord(rack::engine::Module *module, const int64_t frame, const bool all);
+void writerThread();
+
+// Blocks are allocated by the UI thread on first use and passed between
+// engine and writer thread, so recording never allocates.
+std::vector<Block> blocks;
+SpscQueue<Block*, 32> fullBlocks; // Engine -> writer
+SpscQueue<Block*, 32> freeBlocks; // Writer -> engine
+Block *block;
+
+std::vector<uint32_t> lastValues; // Bits of the last recorded value of each id
+size_t maxRecordSize;
+int64_t lastFrame;
+
+std::atomic<bool> recording;   // Requested by the UI thread
+std::atomic<bool> running;     // Engine thread is recording
+std::atomic<bool> done;        // All blocks of the capture are queued
+std::atomic<uint64_t> dropped; // Records lost for lack of free blocks
+
+FILE *file;
+std::thread writer;
+
+};
+
+
+// Reads a capture and applies it frame by frame to a module.
+class InputCaptureReader {
+
+public:
+
+bool open(const std::string &path);
+
+// Applies the records of `frame` (counted from the start of the capture).
+// Returns false once the capture has ended.
+bool apply(rack::engine::Module *module, const int64_t frame);
+
+std::string slug;
+std::string state;
+float sampleRate = 0.0f;
+int numParams = 0;
+int numInputs = 0;
+int numOutputs = 0;
+
+private:
+
+bool readNextFrame();
+
+std::vector<uint8_t> data;
+size_t pos = 0;
+int64_t nextFrame = 0;
+bool ended = true;
+
+};
+
+
+// Context menu entry to start and stop capturing the inputs of a module.
+rack::ui::MenuItem *createInputCaptureMenuItem(rack::engine::Module *module, InputCapture *capture);
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "rack.hpp"
+
+#define HISTOGRAM_NUM_BUCKETS 32
+
+
+// Runtime statistics of a module. Counters use relaxed atomics: they are
+// only read for display, so no ordering between them is needed.
+namespace instrumentation {
+
+// CPU time stamp counter where available, nanoseconds elsewhere.
+inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline const char *cycleCounterUnit() {
+#if defined(__x86_64__) || defined(__i386__)
+	return "TSC ticks";
+#else
+	return "ns";
+#endif
+}
+
+inline uint64_t nanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+struct Counter {
+
+	// Any thread
+	void add(const uint64_t n = 1) {
+		value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	// Only from a single writer thread: avoids the locked add.
+	void addSingle(const uint64_t n = 1) {
+		value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	void set(const uint64_t n) {
+		value.store(n, std::memory_order_relaxed);
+	}
+
+	void setMax(const uint64_t n) {
+		if (n > get()) set(n);
+	}
+
+	uint64_t get() const {
+		return value.load(std::memory_order_relaxed);
+	}
+
+private:
+
+	std::atomic<uint64_t> value{0};
+
+};
+
+
+// Power of two histogram: bucket b counts values in [2^b, 2^(b+1)), bucket 0
+// also counts 0. Single writer.
+struct Histogram {
+
+	void add(const uint64_t value) {
+		const int bucket = (value == 0) ? 0 : std::min(63 - __builtin_clzll(value), HISTOGRAM_NUM_BUCKETS - 1);
+		buckets[bucket].addSingle();
+		maximum.setMax(value);
+	}
+
+	uint64_t count() const {
+		uint64_t total = 0;
+		for (const Counter &bucket : buckets) {
+			total += bucket.get();
+		}
+		return total;
+	}
+
+	// Upper bound of the bucket containing the given fraction (0..1) of the values.
+	uint64_t percentile(const double fraction) const {
+		const uint64_t total = count();
+		uint64_t sum = 0;
+		for (int b = 0; b < HISTOGRAM_NUM_BUCKETS; b++) {
+			sum += buckets[b].get();
+			if (total > 0 && sum >= fraction * total) {
+				return (uint64_t(2) << b) - 1;
+			}
+		}
+		return 0;
+	}
+
+	uint64_t max() const {
+		return maximum.get();
+	}
+
+	void reset() {
+		for (Counter &bucket : buckets) {
+			bucket.set(0);
+		}
+		maximum.set(0);
+	}
+
+	// {"max": ..., "buckets": [[lower bound, count], ...]}, non-empty buckets only.
+	json_t *toJson() const {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "max", json_integer(max()));
+		json_t *bucketsJ = json_array();
+		for (int b = 0; b < HISTOGRAM_NUM_BUCKETS; b++) {
+			if (buckets[b].get() > 0) {
+				json_t *bucketJ = json_array();
+				json_array_append_new(bucketJ, json_integer((b == 0) ? 0 : (int64_t(1) << b)));
+				json_array_append_new(bucketJ, json_integer(buckets[b].get()));
+				json_array_append_new(bucketsJ, bucketJ);
+			}
+		}
+		json_object_set_new(rootJ, "buckets", bucketsJ);
+		return rootJ;
+	}
+
+private:
+
+	Counter buckets[HISTOGRAM_NUM_BUCKETS];
+	Counter maximum;
+
+};
+
+
+// Adds the cycles spent in the enclosing scope to a histogram.
+struct ScopedCycleTimer {
+
+	explicit ScopedCycleTimer(Histogram &histogram) :
+	  histogram(histogram),
+	  start(readCycleCounter())
+	  {}
+
+	~ScopedCycleTimer() {
+		histogram.add(readCycleCounter() - start);
+	}
+
+private:
+
+	Histogram &histogram;
+	const uint64_t start;
+
+};
+
+} // namespace instrumentation
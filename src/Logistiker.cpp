@@ -1,4 +1,22 @@
+#include <thread>
+
 #include "modular80.hpp"
+#include "AdaptiveQuality.hpp"
+#include "BlockKernels.hpp"
+#include "Clock.hpp"
+#include "ControlRate.hpp"
+#include "FastMath.hpp"
+#include "InputCapture.hpp"
+#include "RtSafety.hpp"
+
+#define OSCILLATOR_RATE_OFFSET 6.0f // Rate knob covers 16..4096 Hz in oscillator mode
+#define MAX_OVERSAMPLING 8
+
+#define MAX_R 8.0f
+#define BIFURCATION_WIDTH 256 // Multiple of 4
+#define BIFURCATION_HEIGHT 128
+#define BIFURCATION_SETTLE_ITERATIONS 1000
+#define BIFURCATION_PLOT_ITERATIONS 2000
 
 struct Logistiker : Module {
 	enum ParamIds {
@@ -22,13 +40,14 @@ struct Logistiker : Module {
 		NUM_LIGHTS
 	};
 
-	Logistiker() : x(0.0f),
-		phase(0.0f)
+	Logistiker() : displayR(3.56995f),
+		rate(1.0f),
+		oscillatorRate(1.0f)
 	{
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
 		configParam(RATE_PARAM, -2.0f, 6.0f, 2.0f, "Rate", " Hz"); // 0.25..64 Hz
-		configParam(R_PARAM, 0.0f, 8.0f, 3.56995f, "R"); // default value = onset of chaos
+		configParam(R_PARAM, 0.0f, MAX_R, 3.56995f, "R"); // default value = onset of chaos
 		configParam(X_PARAM, 0.0f, 0.5f, 0.0f, "X");
 		configButton(RESET_PARAM, "Reset");
 
@@ -37,81 +56,447 @@ struct Logistiker : Module {
 		configInput(R_INPUT, "R");
 
 		configOutput(X_OUTPUT, "X");
+
+		block::initDecimator(decimator2, 2);
+		block::initDecimator(decimator4, 4);
+		block::initDecimator(decimator8, 8);
+
+		onReset();
 	}
 
 	void process(const ProcessArgs &args) override;
 	void onReset() override;
 
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+
+		// Option: Control Rate
+		json_object_set_new(rootJ, "controlRateDivision", controlRate.toJson());
+
+		// Option: External Clock Ratio
+		json_object_set_new(rootJ, "clockRatio", clockRatio.toJson());
+
+		// Option: Adaptive Quality
+		json_object_set_new(rootJ, "adaptiveQualityBudget", adaptiveQuality.toJson());
+
+		// Option: Oscillator Mode
+		json_t *oscillatorModeJ = json_boolean(oscillatorMode);
+		json_object_set_new(rootJ, "oscillatorMode", oscillatorModeJ);
+
+		// Option: Oversampling
+		json_t *oversamplingJ = json_integer(oversampling);
+		json_object_set_new(rootJ, "oversampling", oversamplingJ);
+
+		// Option: Interpolation
+		json_t *interpolationJ = json_boolean(interpolation);
+		json_object_set_new(rootJ, "interpolation", interpolationJ);
+
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		// Option: Control Rate
+		controlRate.fromJson(json_object_get(rootJ, "controlRateDivision"));
+
+		// Option: External Clock Ratio
+		clockRatio.fromJson(json_object_get(rootJ, "clockRatio"));
+
+		// Option: Adaptive Quality
+		adaptiveQuality.fromJson(json_object_get(rootJ, "adaptiveQualityBudget"));
+
+		// Option: Oscillator Mode
+		json_t *oscillatorModeJ = json_object_get(rootJ, "oscillatorMode");
+		if (oscillatorModeJ) oscillatorMode = json_boolean_value(oscillatorModeJ);
+
+		// Option: Oversampling
+		json_t *oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ) setOversampling(json_integer_value(oversamplingJ));
+
+		// Option: Interpolation
+		json_t *interpolationJ = json_object_get(rootJ, "interpolation");
+		if (interpolationJ) interpolation = json_boolean_value(interpolationJ);
+	}
+
+	// Oversampling factor of the oscillator mode: 1, 2, 4 or 8. May be called from the UI thread.
+	void setOversampling(const int factor) {
+		int f = 1;
+		while (f < factor && f < MAX_OVERSAMPLING) f *= 2;
+		oversampling = f;
+	}
+	int getOversampling() const {
+		return oversampling;
+	}
+
+	ControlRate controlRate;
+	ClockRatio clockRatio;
+	AdaptiveQuality adaptiveQuality;
+	InputCapture inputCapture;
+
+	// Iterate the map at audio rate with a bipolar output, instead of as a clocked CV source.
+	std::atomic<bool> oscillatorMode;
+	// Interpolate linearly between iterates in oscillator mode.
+	std::atomic<bool> interpolation;
+
+	// R of the first channel, for the panel display.
+	std::atomic<float> displayR;
+
 private:
-	float logistic(const float x, const float r);
+	template <typename T>
+	T logistic(const T x, const T r);
+	void iterate(const int c, const simd::float_4 doStep, const simd::float_4 r);
 
 	dsp::SchmittTrigger rstButtonTrigger;
-	dsp::SchmittTrigger rstInputTrigger;
-	dsp::SchmittTrigger clkTrigger;
 
-	float x;
-	float phase;
+	// One map per channel, clocked 4 channels at a time.
+	dsp::TSchmittTrigger<simd::float_4> rstInputTrigger[PORT_MAX_CHANNELS / 4];
+	Clock4 clock[PORT_MAX_CHANNELS / 4];
+
+	// x of each map. The phase is that of the oscillator mode, which runs all maps at once.
+	block::LogisticLanes maps;
+
+	float rate;
+	float oscillatorRate;
+
+	// Oscillator mode
+	std::atomic<int> oversampling;
+	block::DecimatorLanes decimator2;
+	block::DecimatorLanes decimator4;
+	block::DecimatorLanes decimator8;
 };
 
 void Logistiker::onReset() {
-	x = 0.0f;
-	phase = 0.0f;
+	for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+		maps.x[c] = 0.0f;
+		maps.lastX[c] = 0.0f;
+		maps.phase[c] = 0.0f;
+		maps.reset[c] = 0.0f;
+	}
+	for (int b = 0; b < PORT_MAX_CHANNELS / 4; b++) {
+		rstInputTrigger[b].reset();
+		clock[b].reset();
+	}
+	controlRate.setDivision(CONTROL_RATE_DEFAULT_DIVISION);
+	controlRate.reset();
+	clockRatio.setIndex(CLOCK_DEFAULT_RATIO);
+	adaptiveQuality.setBudget(0.0f);
+	oscillatorMode = false;
+	oversampling = 4;
+	interpolation = true;
 }
 
-float Logistiker::logistic(const float x, const float r) {
+template <typename T>
+T Logistiker::logistic(const T x, const T r) {
 	return(r * x * (1.0f - x));
 }
 
+// One iteration of the maps of channels c .. c + 3 in the lanes set in doStep.
+// The oscillator mode does the same in block::logisticOscillator().
+void Logistiker::iterate(const int c, const simd::float_4 doStep, const simd::float_4 r) {
+	simd::float_4 x = simd::float_4::load(&maps.x[c]);
+	simd::float_4 lastX = simd::ifelse(doStep, x, simd::float_4::load(&maps.lastX[c]));
+	simd::float_4 doReset = simd::float_4::load(&maps.reset[c]);
+
+	// Synchronize resetting x with steps.
+	x = simd::ifelse(doStep & doReset, params[X_PARAM].getValue(), x);
+	doReset = simd::ifelse(doStep, 0.0f, doReset);
+
+	// Don't let population die!
+	x = simd::ifelse(doStep, simd::clamp(logistic(x, r), 0.00001f, 1.0f), x);
+
+	x.store(&maps.x[c]);
+	lastX.store(&maps.lastX[c]);
+	doReset.store(&maps.reset[c]);
+}
+
 void Logistiker::process(const ProcessArgs &args) {
+	RT_SAFE_SCOPE("Logistiker::process");
+	AdaptiveQuality::Timer qualityTimer(adaptiveQuality, args);
+	inputCapture.process(this, args);
+
+	// Knobs are read at control rate. Clock, reset and R inputs stay at audio rate.
+	const bool controlFrame = controlRate.process();
+	if (controlFrame) {
+		rate = fastmath::exp2(params[RATE_PARAM].getValue());
+		oscillatorRate = rate * fastmath::exp2(OSCILLATOR_RATE_OFFSET);
+		displayR = clamp(params[R_PARAM].getValue() + inputs[R_INPUT].getVoltage(0), 0.0f, MAX_R);
+	}
+
 	if (!outputs[X_OUTPUT].isConnected()) {
 		return;
 	}
 
-	static bool doReset(false);
+	// The reset button resets all maps.
+	const bool resetAll = controlFrame && rstButtonTrigger.process(params[RESET_PARAM].getValue());
+
+	// Each channel of the polyphonic inputs drives its own map.
+	int channels = 1;
+	for (const int input : {CLK_INPUT, RST_INPUT, R_INPUT}) {
+		channels = std::max(channels, inputs[input].getChannels());
+	}
+
+	const bool extClock = inputs[CLK_INPUT].isConnected();
+	const bool extReset = inputs[RST_INPUT].isConnected();
+
+	// Under CPU pressure, oversampling is halved per level and minimal quality drops interpolation.
+	const AdaptiveQuality::Level quality = adaptiveQuality.getLevel();
+	const bool oscillator = oscillatorMode;
+	const bool interpolate = interpolation && quality < AdaptiveQuality::MINIMAL_QUALITY;
+	const int factor = std::max(oversampling >> quality, 1);
+	int multiply, divide;
+	clockRatio.get(multiply, divide);
+	// At most one iteration every two (oversampled) frames.
+	const float deltaPhase = std::min(oscillatorRate * args.sampleTime / factor, 0.5f);
+
+	// R of each map, for the oscillator mode.
+	float oscillatorR[PORT_MAX_CHANNELS];
+
+	for (int c = 0; c < channels; c += 4) {
+		const int b = c / 4;
+
+		simd::float_4 doReset = simd::float_4::load(&maps.reset[c]);
+		if (resetAll) {
+			doReset = simd::float_4::mask();
+		}
+		if (extReset) {
+			doReset |= rstInputTrigger[b].process(inputs[RST_INPUT].getPolyVoltageSimd<simd::float_4>(c));
+		}
+		doReset.store(&maps.reset[c]);
+
+		simd::float_4 r = simd::clamp(params[R_PARAM].getValue() + inputs[R_INPUT].getPolyVoltageSimd<simd::float_4>(c), 0.0f, MAX_R);
+
+		if (oscillator) {
+			// The clock input hard-syncs the oscillator.
+			if (extClock) {
+				const simd::float_4 edge = clock[b].sync(inputs[CLK_INPUT].getPolyVoltageSimd<simd::float_4>(c));
+				simd::float_4 phase = simd::ifelse(edge, 0.0f, simd::float_4::load(&maps.phase[c]));
+				phase.store(&maps.phase[c]);
+			}
+			r.store(&oscillatorR[c]);
+			continue;
+		}
+
+		simd::float_4 offset;
+		simd::float_4 doStep;
+		if (extClock) { // External clock
+			doStep = clock[b].processExternal(inputs[CLK_INPUT].getPolyVoltageSimd<simd::float_4>(c), multiply, divide, offset);
+		}
+		else { // Internal clock
+			doStep = clock[b].processInternal(rate * args.sampleTime, offset);
+		}
+
+		if (simd::movemask(doStep)) {
+			iterate(c, doStep, r);
+		}
+
+		outputs[X_OUTPUT].setVoltageSimd(simd::clamp(simd::float_4::load(&maps.x[c]) * 10.0f, -10.0f, 10.0f), c);
+	}
+
+	if (oscillator) {
+		const int lanes = (channels + 3) / 4 * 4;
+		float buffer[MAX_OVERSAMPLING][PORT_MAX_CHANNELS];
+		block::logisticOscillator(maps, oscillatorR, params[X_PARAM].getValue(), deltaPhase, interpolate, lanes, factor, buffer[0]);
+
+		float y[PORT_MAX_CHANNELS];
+		switch (factor) {
+			case 2: block::decimate(decimator2, buffer[0], lanes, y); break;
+			case 4: block::decimate(decimator4, buffer[0], lanes, y); break;
+			case 8: block::decimate(decimator8, buffer[0], lanes, y); break;
+			default: std::copy(buffer[0], buffer[0] + lanes, y); break;
+		}
+
+		// Bipolar audio output.
+		for (int c = 0; c < channels; c += 4) {
+			outputs[X_OUTPUT].setVoltageSimd(simd::clamp((simd::float_4::load(&y[c]) - 0.5f) * 10.0f, -10.0f, 10.0f), c);
+		}
+	}
 
-	if (rstButtonTrigger.process(params[RESET_PARAM].getValue()) ||
-	   (inputs[RST_INPUT].isConnected() && rstInputTrigger.process(inputs[RST_INPUT].getVoltage())))
+	outputs[X_OUTPUT].setChannels(channels);
+}
+
+// Bifurcation diagram and Lyapunov exponents of the map over the full R range.
+// Takes millions of iterations, so it is computed once on a worker thread and
+// shared by all displays. The UI only draws the finished image.
+struct LogistikerBifurcation {
+
+	LogistikerBifurcation() :
+	  pixels(BIFURCATION_WIDTH * BIFURCATION_HEIGHT * 4, 0),
+	  abort(false),
+	  ready(false)
 	{
-		doReset = true;
+		worker = std::thread(&LogistikerBifurcation::compute, this);
 	}
 
-	bool doStep(false);
+	~LogistikerBifurcation() {
+		abort = true;
+		worker.join();
+	}
 
-	// External clock
-	if (inputs[CLK_INPUT].isConnected()) {
-		if (clkTrigger.process(inputs[CLK_INPUT].getVoltage())) {
-			phase = 0.0f;
-			doStep = true;
+	// UI thread only.
+	static std::shared_ptr<LogistikerBifurcation> get() {
+		static std::weak_ptr<LogistikerBifurcation> cache;
+		std::shared_ptr<LogistikerBifurcation> bifurcation = cache.lock();
+		if (!bifurcation) {
+			bifurcation = std::make_shared<LogistikerBifurcation>();
+			cache = bifurcation;
 		}
+		return bifurcation;
 	}
-	else {
-		// Internal clock
-		phase += pow(2.0f, params[RATE_PARAM].getValue()) * args.sampleTime;
-		if (phase >= 1.0f) {
-			phase = 0.0f;
-			doStep = true;
+
+	// Pixels and exponents may only be used once ready.
+	bool isReady() const {
+		return ready;
+	}
+
+	// RGBA, BIFURCATION_WIDTH x BIFURCATION_HEIGHT, x = 1 at the top.
+	const uint8_t *getPixels() const {
+		return pixels.data();
+	}
+
+	float getLyapunov(const float r) const {
+		const int column = clamp(static_cast<int>(r / MAX_R * BIFURCATION_WIDTH), 0, BIFURCATION_WIDTH - 1);
+		return lyapunov[column];
+	}
+
+private:
+
+	void compute() {
+		std::vector<uint16_t> counts(BIFURCATION_WIDTH * BIFURCATION_HEIGHT, 0);
+
+		// 4 neighbouring columns at once.
+		for (int column = 0; column < BIFURCATION_WIDTH; column += 4) {
+			if (abort) {
+				return;
+			}
+
+			const simd::float_4 r = (simd::float_4(column, column + 1, column + 2, column + 3) + 0.5f) * (MAX_R / BIFURCATION_WIDTH);
+			simd::float_4 x = 0.1f;
+			simd::float_4 sumLog = 0.0f;
+
+			// Same iteration as the module, including the clamp.
+			for (int i = 0; i < BIFURCATION_SETTLE_ITERATIONS; i++) {
+				x = simd::clamp(r * x * (1.0f - x), 0.00001f, 1.0f);
+			}
+			for (int i = 0; i < BIFURCATION_PLOT_ITERATIONS; i++) {
+				sumLog += simd::log(simd::fmax(simd::abs(r * (1.0f - 2.0f * x)), 1e-6f));
+				x = simd::clamp(r * x * (1.0f - x), 0.00001f, 1.0f);
+
+				for (int lane = 0; lane < 4; lane++) {
+					const int row = (BIFURCATION_HEIGHT - 1) - static_cast<int>(x[lane] * (BIFURCATION_HEIGHT - 1) + 0.5f);
+					counts[row * BIFURCATION_WIDTH + column + lane]++;
+				}
+			}
+
+			for (int lane = 0; lane < 4; lane++) {
+				lyapunov[column + lane] = sumLog[lane] / BIFURCATION_PLOT_ITERATIONS;
+			}
 		}
+
+		// Brightness relative to the densest pixel of each column.
+		for (int column = 0; column < BIFURCATION_WIDTH; column++) {
+			int maxCount = 1;
+			for (int row = 0; row < BIFURCATION_HEIGHT; row++) {
+				maxCount = std::max(maxCount, static_cast<int>(counts[row * BIFURCATION_WIDTH + column]));
+			}
+			for (int row = 0; row < BIFURCATION_HEIGHT; row++) {
+				const int count = counts[row * BIFURCATION_WIDTH + column];
+				uint8_t *pixel = &pixels[(row * BIFURCATION_WIDTH + column) * 4];
+				pixel[0] = 0xff;
+				pixel[1] = 0x60;
+				pixel[2] = 0x60;
+				pixel[3] = (count > 0) ? 0x40 + static_cast<int>(0xbf * std::sqrt(static_cast<float>(count) / maxCount)) : 0;
+			}
+		}
+
+		ready = true;
 	}
 
-	if (doStep) {
+	std::vector<uint8_t> pixels;
+	float lyapunov[BIFURCATION_WIDTH];
 
-		// Synchronize resetting x with steps.
-		if (doReset) {
-			x = params[X_PARAM].getValue();
-			doReset = false;
+	std::atomic<bool> abort;
+	std::atomic<bool> ready;
+	std::thread worker;
+
+};
+
+
+// Bifurcation diagram with a cursor at the current R and its Lyapunov exponent
+// (positive means chaos).
+struct LogistikerBifurcationDisplay : TransparentWidget {
+	Logistiker *module = nullptr;
+	std::shared_ptr<LogistikerBifurcation> bifurcation = LogistikerBifurcation::get();
+	int image = 0;
+
+	~LogistikerBifurcationDisplay() {
+		if (image) {
+			nvgDeleteImage(APP->window->vg, image);
+		}
+	}
+
+	void onContextDestroy(const ContextDestroyEvent &e) override {
+		if (image) {
+			nvgDeleteImage(e.vg, image);
+			image = 0;
+		}
+		TransparentWidget::onContextDestroy(e);
+	}
+
+	void drawLayer(const DrawArgs &args, int layer) override {
+		if (layer != 1) {
+			return;
+		}
+
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0.0f, 0.0f, box.size.x, box.size.y);
+		nvgFillColor(args.vg, nvgRGBA(0x10, 0x10, 0x10, 0xff));
+		nvgFill(args.vg);
+
+		if (!bifurcation->isReady()) {
+			return;
 		}
 
-		const float r = clamp(params[R_PARAM].getValue() + inputs[R_INPUT].getVoltage(), 0.0f, 8.0f);
+		if (!image) {
+			image = nvgCreateImageRGBA(args.vg, BIFURCATION_WIDTH, BIFURCATION_HEIGHT, 0, bifurcation->getPixels());
+		}
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0.0f, 0.0f, box.size.x, box.size.y);
+		nvgFillPaint(args.vg, nvgImagePattern(args.vg, 0.0f, 0.0f, box.size.x, box.size.y, 0.0f, image, 1.0f));
+		nvgFill(args.vg);
+
+		if (!module) {
+			return;
+		}
+
+		// R cursor
+		const float r = module->displayR;
+		const float cursorX = r / MAX_R * box.size.x;
+		nvgBeginPath(args.vg);
+		nvgMoveTo(args.vg, cursorX, 0.0f);
+		nvgLineTo(args.vg, cursorX, box.size.y);
+		nvgStrokeColor(args.vg, nvgRGBA(0xff, 0xff, 0xff, 0xff));
+		nvgStrokeWidth(args.vg, 1.0f);
+		nvgStroke(args.vg);
 
-		// Don't let population die!
-		x = clamp(logistic(x, r), 0.00001f, 1.0f);
+		// Lyapunov exponent
+		const float lyapunov = bifurcation->getLyapunov(r);
+		char text[16];
+		snprintf(text, sizeof(text), "%+.2f", lyapunov);
+
+		std::shared_ptr<window::Font> font = APP->window->loadFont(asset::system("res/fonts/ShareTechMono-Regular.ttf"));
+		if (font) {
+			nvgFontFaceId(args.vg, font->handle);
+			nvgFontSize(args.vg, 9.0f);
+			nvgTextAlign(args.vg, NVG_ALIGN_LEFT | NVG_ALIGN_BOTTOM);
+			nvgFillColor(args.vg, (lyapunov > 0.0f) ? nvgRGBA(0xff, 0x60, 0x60, 0xff) : nvgRGBA(0xff, 0xff, 0xff, 0xff));
+			nvgText(args.vg, 1.0f, box.size.y - 1.0f, text, nullptr);
+		}
 	}
+};
 
-	outputs[X_OUTPUT].setVoltage(clamp(x * 10.0f, -10.0f, 10.0f));
-}
 
 struct LogistikerWidget : ModuleWidget {
 	LogistikerWidget(Logistiker *module);
+	void appendContextMenu(Menu *menu) override;
 };
 
 LogistikerWidget::LogistikerWidget(Logistiker *module) {
@@ -134,8 +519,40 @@ LogistikerWidget::LogistikerWidget(Logistiker *module) {
 
 	addOutput(createOutput<PJ301MPort>(Vec(33, 319), module, Logistiker::X_OUTPUT));
 
+	LogistikerBifurcationDisplay *bifurcationDisplay = createWidget<LogistikerBifurcationDisplay>(Vec(6, 176));
+	bifurcationDisplay->box.size = Vec(38, 36);
+	bifurcationDisplay->module = module;
+	addChild(bifurcationDisplay);
+
 	addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 	addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 }
 
+void LogistikerWidget::appendContextMenu(Menu *menu) {
+	Logistiker *module = dynamic_cast<Logistiker*>(this->module);
+
+	menu->addChild(new MenuSeparator);
+	menu->addChild(createClockRatioMenuItem(&module->clockRatio));
+	menu->addChild(createControlRateMenuItem(&module->controlRate));
+	menu->addChild(createAdaptiveQualityMenuItem(&module->adaptiveQuality));
+
+	menu->addChild(new MenuSeparator);
+	menu->addChild(createBoolMenuItem("Oscillator mode", "",
+		[=]() { return module->oscillatorMode.load(); },
+		[=](bool enabled) { module->oscillatorMode = enabled; }));
+	menu->addChild(createIndexSubmenuItem("Oversampling", {"Off", "2x", "4x", "8x"},
+		[=]() {
+			size_t index = 0;
+			while ((1 << index) < module->getOversampling()) index++;
+			return index;
+		},
+		[=](size_t index) { module->setOversampling(1 << index); }));
+	menu->addChild(createBoolMenuItem("Interpolation", "",
+		[=]() { return module->interpolation.load(); },
+		[=](bool enabled) { module->interpolation = enabled; }));
+
+	menu->addChild(new MenuSeparator);
+	menu->addChild(createInputCaptureMenuItem(module, &module->inputCapture));
+}
+
 Model *modelLogistiker = createModel<Logistiker, LogistikerWidget>("Logistiker");
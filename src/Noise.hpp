@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "BlockKernels.hpp"
+
+
+// Seedable noise with an independent stream per channel, generated in blocks
+// (block::noise).
+namespace noise {
+
+enum Colour {
+	WHITE,
+	PINK,
+	BROWN,
+	NUM_COLOURS
+};
+
+// SplitMix64, used to expand one seed into generator states.
+inline uint64_t splitMix64(uint64_t &state) {
+	uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// Seeds the 4 lanes of a group from one seed and clears their filters.
+inline void seed(block::NoiseLanes &lanes, const int group, uint64_t seed) {
+	for (int lane = group * 4; lane < group * 4 + 4; lane++) {
+		const uint64_t a = splitMix64(seed);
+		const uint64_t b = splitMix64(seed);
+		lanes.s0[lane] = a;
+		lanes.s1[lane] = a >> 32;
+		lanes.s2[lane] = b;
+		lanes.s3[lane] = b >> 32;
+		lanes.pink0[lane] = lanes.pink1[lane] = lanes.pink2[lane] = 0.0f;
+		lanes.brown[lane] = 0.0f;
+	}
+}
+
+} // namespace noise
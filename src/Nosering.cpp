@@ -1,13 +1,51 @@
 #include "modular80.hpp"
+#include "AdaptiveQuality.hpp"
+#include "BlockKernels.hpp"
+#include "Clock.hpp"
+#include "ControlRate.hpp"
+#include "FastMath.hpp"
+#include "InputCapture.hpp"
+#include "Noise.hpp"
+#include "RtSafety.hpp"
 
 //#define DEBUG_MODE
 
-#define SR_SIZE 8
-#define MAX_FREQ 10000.0f
+#define DAC_SIZE 8 // DACs read the first 8 stages of the shift register
+#define MIN_SR_LENGTH 4
+#define MAX_SR_LENGTH 64
+#define DEFAULT_SR_LENGTH 8
+#define MAX_FREQ 20000.0f // Internal clock is also limited to half the sample rate
+#define NOISE_BLOCK_SIZE 32
+#define OVERSAMPLE 4
 
 // Resistor ladder values for Digital-to-Analog conversion
-const float DAC_MULT1[SR_SIZE] = {1.28f, 1.28f, 1.28f, 1.28f, 1.28f, 1.28f, 1.28f, 1.28f};
-const float DAC_MULT2[SR_SIZE] = {5.0f, 2.5f, 1.25f, 0.625f, 0.3125f, 0.1525f, 0.078125f, 0.0390625f};
+constexpr float DAC_MULT1[DAC_SIZE] = {1.28f, 1.28f, 1.28f, 1.28f, 1.28f, 1.28f, 1.28f, 1.28f};
+constexpr float DAC_MULT2[DAC_SIZE] = {5.0f, 2.5f, 1.25f, 0.625f, 0.3125f, 0.1525f, 0.078125f, 0.0390625f};
+
+// DAC output for the stage bits in `bits` (stage 0 = bit 0), summed in stage order.
+constexpr float dacValue(const float *mult, const unsigned int bits, const unsigned int stage = 0, const float sum = 0.0f) {
+	return (stage == DAC_SIZE) ? sum :
+		dacValue(mult, bits, stage + 1, sum + static_cast<float>((bits >> stage) & 1u) * mult[stage]);
+}
+
+template <size_t... I>
+constexpr fastmath::Table<sizeof...(I)> dacTable(const float *mult, fastmath::Indices<I...>) {
+	return {{dacValue(mult, I)...}};
+}
+
+// DAC outputs for all states of the DAC stages.
+constexpr fastmath::Table<1 << DAC_SIZE> DAC_TABLE1 = dacTable(DAC_MULT1, fastmath::MakeIndices<1 << DAC_SIZE>::type());
+constexpr fastmath::Table<1 << DAC_SIZE> DAC_TABLE2 = dacTable(DAC_MULT2, fastmath::MakeIndices<1 << DAC_SIZE>::type());
+
+// Selectable shift register lengths.
+const int SR_LENGTHS[] = {4, 5, 6, 7, 8, 12, 16, 24, 32, 48, 64};
+
+enum AntiAliasing {
+	NO_ANTI_ALIASING,
+	MINBLEP_ANTI_ALIASING,
+	OVERSAMPLED_ANTI_ALIASING,
+	NUM_ANTI_ALIASING_MODES
+};
 
 struct Nosering : Module {
 	enum ParamIds {
@@ -35,7 +73,7 @@ struct Nosering : Module {
 		NUM_LIGHTS
 	};
 
-	Nosering()
+	Nosering() : freq(1.0f)
 	{
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -53,130 +91,395 @@ struct Nosering : Module {
 		configOutput(N_PLUS_1_OUTPUT, "n+1");
 		configOutput(TWO_POW_N_OUTPUT, "2^n");
 		configOutput(NOISE_OUTPUT, "Noise");
+
+		block::initDecimator(nPlus1Decimator, OVERSAMPLE);
+		block::initDecimator(twoPowNDecimator, OVERSAMPLE);
+
+		onReset();
 	}
 
 	void process(const ProcessArgs &args) override;
 	void onReset() override;
 
-private:
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+
+		// Option: Control Rate
+		json_object_set_new(rootJ, "controlRateDivision", controlRate.toJson());
+
+		// Option: External Clock Ratio
+		json_object_set_new(rootJ, "clockRatio", clockRatio.toJson());
+
+		// Option: Adaptive Quality
+		json_object_set_new(rootJ, "adaptiveQualityBudget", adaptiveQuality.toJson());
+
+		// Option: Shift Register Length
+		json_t *lengthJ = json_integer(length);
+		json_object_set_new(rootJ, "length", lengthJ);
+
+		// Option: Noise Colour
+		json_t *colourJ = json_integer(noiseColour);
+		json_object_set_new(rootJ, "noiseColour", colourJ);
+
+		// Option: Noise Seed (0 = random)
+		json_t *seedJ = json_integer(seed);
+		json_object_set_new(rootJ, "seed", seedJ);
+
+		// Option: Anti-Aliasing
+		json_t *antiAliasingJ = json_integer(antiAliasing);
+		json_object_set_new(rootJ, "antiAliasing", antiAliasingJ);
+
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		// Option: Control Rate
+		controlRate.fromJson(json_object_get(rootJ, "controlRateDivision"));
+
+		// Option: External Clock Ratio
+		clockRatio.fromJson(json_object_get(rootJ, "clockRatio"));
+
+		// Option: Adaptive Quality
+		adaptiveQuality.fromJson(json_object_get(rootJ, "adaptiveQualityBudget"));
 
-	float phase;
+		// Option: Shift Register Length
+		json_t *lengthJ = json_object_get(rootJ, "length");
+		if (lengthJ) setLength(json_integer_value(lengthJ));
 
-	dsp::SchmittTrigger clkTrigger;
+		// Option: Noise Colour
+		json_t *colourJ = json_object_get(rootJ, "noiseColour");
+		if (colourJ) setNoiseColour(json_integer_value(colourJ));
 
-	unsigned int shiftRegister[SR_SIZE] = {0,0,0,0,0,0,0,0};
+		// Option: Noise Seed (0 = random)
+		json_t *seedJ = json_object_get(rootJ, "seed");
+		if (seedJ) setSeed(json_integer_value(seedJ));
+
+		// Option: Anti-Aliasing
+		json_t *antiAliasingJ = json_object_get(rootJ, "antiAliasing");
+		if (antiAliasingJ) setAntiAliasing(json_integer_value(antiAliasingJ));
+	}
+
+	// May be called from the UI thread. Takes effect with the next step.
+	void setLength(const int newLength) {
+		length = clamp(newLength, MIN_SR_LENGTH, MAX_SR_LENGTH);
+	}
+	int getLength() const {
+		return length;
+	}
+
+	// May be called from the UI thread. Takes effect with the next noise block.
+	void setNoiseColour(const int colour) {
+		noiseColour = clamp(colour, 0, noise::NUM_COLOURS - 1);
+	}
+	int getNoiseColour() const {
+		return noiseColour;
+	}
+
+	// A fixed seed makes the noise (and all rings) repeat after each load or reset.
+	// May be called from the UI thread. Restarts the noise generators.
+	void setSeed(const uint32_t newSeed) {
+		seed = newSeed;
+		reseed = true;
+	}
+	uint32_t getSeed() const {
+		return seed;
+	}
+
+	// Band-limits the n+1 and 2^n outputs for audio rate clocks. May be called from the UI thread.
+	void setAntiAliasing(const int mode) {
+		antiAliasing = clamp(mode, 0, NUM_ANTI_ALIASING_MODES - 1);
+	}
+	int getAntiAliasing() const {
+		return antiAliasing;
+	}
+
+	ControlRate controlRate;
+	ClockRatio clockRatio;
+	AdaptiveQuality adaptiveQuality;
+	InputCapture inputCapture;
+
+private:
+
+	void stepRing(const int c, const float noiseSample, const float sample);
+	void stepRings(const int c, const int channels, const int stepMask,
+		const simd::float_4 noiseSample, const simd::float_4 sample);
+	simd::float_4 clockRings(const int b, const simd::float_4 clock, const bool extClock,
+		const int multiply, const int divide, const float deltaPhase, simd::float_4 &offset);
+	void seedNoise();
+
+	float freq;
+
+	// Noise of each ring, generated one block at a time.
+	block::NoiseLanes noiseLanes;
+	float noiseBlock[NOISE_BLOCK_SIZE][PORT_MAX_CHANNELS];
+	int noisePos;
+	int noiseChannels;
+	std::atomic<int> noiseColour;
+	std::atomic<uint32_t> seed;
+	std::atomic<bool> reseed;
+
+	// Clock of each ring. Rings are processed 4 at a time in SIMD lanes.
+	Clock4 clock[PORT_MAX_CHANNELS / 4];
+	simd::float_4 lastClock[PORT_MAX_CHANNELS / 4]; // For oversampling
+
+	// Anti-aliasing of the DAC outputs
+	std::atomic<int> antiAliasing;
+	dsp::MinBlepGenerator<16, 16, simd::float_4> nPlus1Blep[PORT_MAX_CHANNELS / 4];
+	dsp::MinBlepGenerator<16, 16, simd::float_4> twoPowNBlep[PORT_MAX_CHANNELS / 4];
+	block::DecimatorLanes nPlus1Decimator;
+	block::DecimatorLanes twoPowNDecimator;
+
+	// Stage n is bit n. Stage 0 holds the newest bit.
+	uint64_t shiftRegister[PORT_MAX_CHANNELS];
+
+	// DAC outputs, only updated when the shift register changes.
+	float nPlus1Output[PORT_MAX_CHANNELS];
+	float twoPowNOutput[PORT_MAX_CHANNELS];
+
+	std::atomic<int> length;
 };
 
 void Nosering::onReset() {
-	phase = 0.0f;
+	for (int b = 0; b < PORT_MAX_CHANNELS / 4; b++) {
+		clock[b].reset();
+		lastClock[b] = 0.0f;
+	}
 
-	for (unsigned int &val : shiftRegister) {
-		val = 0;
+	for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+		shiftRegister[c] = 0;
+		nPlus1Output[c] = 0.0f;
+		twoPowNOutput[c] = 0.0f;
 	}
+
+	length = DEFAULT_SR_LENGTH;
+	antiAliasing = NO_ANTI_ALIASING;
+	noiseColour = noise::WHITE;
+	seed = 0;
+	seedNoise();
+
+	controlRate.setDivision(CONTROL_RATE_DEFAULT_DIVISION);
+	controlRate.reset();
+	clockRatio.setIndex(CLOCK_DEFAULT_RATIO);
+	adaptiveQuality.setBudget(0.0f);
 }
 
-void Nosering::process(const ProcessArgs &args) {
+void Nosering::seedNoise() {
+	const uint32_t fixedSeed = seed;
+	uint64_t state = fixedSeed ? fixedSeed : random::u64();
+	for (int b = 0; b < PORT_MAX_CHANNELS / 4; b++) {
+		noise::seed(noiseLanes, b, noise::splitMix64(state));
+	}
+	noisePos = NOISE_BLOCK_SIZE;
+	noiseChannels = 0;
+	reseed = false;
+}
+
+void Nosering::stepRing(const int c, const float noiseSample, const float sample) {
+	// Inputs are sampled with the clock, so CV changing on the same edge is picked up.
+	const float change = clamp((params[CHANGE_PARAM].getValue() + inputs[CHANGE_INPUT].getPolyVoltage(c)), -10.0f, 10.0f);
+	const float chance = clamp((params[CHANCE_PARAM].getValue() + inputs[CHANCE_INPUT].getPolyVoltage(c)), -10.0f, 10.0f);
+
+	bool selectNewData = (noiseSample > change); // Always compare against White Noise
 
-	bool doStep(false);
+	const int n = length;
+	const uint64_t mask = (n == 64) ? ~0ull : ((1ull << n) - 1);
 
-	// Inputs
-	const float change = clamp((params[CHANGE_PARAM].getValue() + inputs[CHANGE_INPUT].getVoltage()), -10.0f, 10.0f);
-	const float chance = clamp((params[CHANCE_PARAM].getValue() + inputs[CHANCE_INPUT].getVoltage()), -10.0f, 10.0f);
+	// Bits beyond a shortened register are dropped.
+	shiftRegister[c] &= mask;
 
-	// Generate White noise sample
-	const float noiseSample = clamp((random::uniform() * 20.0f - 10.0f), -10.0f, 10.0f);
+	unsigned int newData = (sample > chance) ? 0 : 1;
+	unsigned int oldData = (shiftRegister[c] >> (n - 1)) & 1;
 
-	// Either use Chance input to sample data for Chance comparator or White Noise.
-	float sample(0.0f);
-	if (inputs[EXT_CHANCE_INPUT].isConnected()) {
-		sample = inputs[EXT_CHANCE_INPUT].getVoltage();
-	} else {
-		sample = noiseSample;
+	const bool invertOldData = (params[INVERT_OLD_DATA_PARAM].getValue() != 0.0f) ||
+							   (inputs[INV_OUT_INPUT].getPolyVoltage(c) != 0.0f);
+	if (invertOldData) {
+		oldData = (oldData == 1) ? 0 : 1;
 	}
 
-	// External clock
-	if (inputs[EXT_RATE_INPUT].isConnected()) {
-		if (clkTrigger.process(inputs[EXT_RATE_INPUT].getVoltage())) {
-			phase = 0.0f;
-			doStep = true;
+	const int sum = __builtin_popcountll(shiftRegister[c]);
+
+	// Only do stale data detection if we are not inverting old data.invertOldData
+	// If we are, the shift register should never be stale.
+	if (!invertOldData) {
+		// Stale data detection (either all 0s or all 1s in the shift register).
+		if (sum == 0) {
+			selectNewData = true;
+			newData = 1;
+		} else if (sum == n) {
+			selectNewData = true;
+			newData = 0;
 		}
 	}
-	else { // Internal clock
-		float freq = powf(2.0f, params[INT_RATE_PARAM].getValue());
+
+	// Advance shift register and move data into it
+	shiftRegister[c] = ((shiftRegister[c] << 1) | ((selectNewData) ? newData : oldData)) & mask;
+
+#ifdef DEBUG_MODE
+	for (int i = 0; i < n; ++i) {
+		debug("%d %d %d", c, i, (int)((shiftRegister[c] >> i) & 1));
+	}
+#endif
+
+	// DAC
+	const unsigned int dacBits = shiftRegister[c] & ((1u << DAC_SIZE) - 1);
+	nPlus1Output[c] = clamp(DAC_TABLE1[dacBits], 0.0f, 10.0f);
+	twoPowNOutput[c] = clamp(DAC_TABLE2[dacBits], 0.0f, 10.0f);
+}
+
+void Nosering::stepRings(const int c, const int channels, const int stepMask,
+	const simd::float_4 noiseSample, const simd::float_4 sample) {
+	// Steps are rare, so the registers are advanced lane by lane.
+	for (int i = 0; i < 4 && c + i < channels; i++) {
+		if (stepMask & (1 << i)) {
+			stepRing(c + i, noiseSample[i], sample[i]);
+		}
+	}
+}
+
+// Advance the clocks of 4 rings by one (sub)sample. Returns the lanes that step and,
+// in `offset`, when each step happened relative to the current sample (-1 < offset <= 0).
+simd::float_4 Nosering::clockRings(const int b, const simd::float_4 extClockVoltage, const bool extClock,
+	const int multiply, const int divide, const float deltaPhase, simd::float_4 &offset) {
+	if (extClock) {
+		return clock[b].processExternal(extClockVoltage, multiply, divide, offset);
+	}
+	return clock[b].processInternal(deltaPhase, offset);
+}
+
+void Nosering::process(const ProcessArgs &args) {
+	RT_SAFE_SCOPE("Nosering::process");
+	AdaptiveQuality::Timer qualityTimer(adaptiveQuality, args);
+	inputCapture.process(this, args);
+
+	// Rate knob is read at control rate.
+	if (controlRate.process()) {
+		freq = fastmath::exp2(params[INT_RATE_PARAM].getValue());
 
 		// Limit internal rate.
 		if (freq > MAX_FREQ) {
 			freq = MAX_FREQ;
 		}
+	}
 
-		phase += freq * args.sampleTime;
-		if (phase >= 1.0f) {
-			phase = 0.0f;
-			doStep = true;
-		}
+	// Each channel of the polyphonic inputs drives its own ring.
+	int channels = 1;
+	for (const int input : {CHANGE_INPUT, CHANCE_INPUT, EXT_RATE_INPUT, EXT_CHANCE_INPUT, INV_OUT_INPUT}) {
+		channels = std::max(channels, inputs[input].getChannels());
 	}
 
-	if (doStep) {
-		bool selectNewData = (noiseSample > change); // Always compare against White Noise
+	const bool extClock = inputs[EXT_RATE_INPUT].isConnected();
+	const bool extChance = inputs[EXT_CHANCE_INPUT].isConnected();
 
-		unsigned int newData = (sample > chance) ? 0 : 1;
-		unsigned int oldData = shiftRegister[SR_SIZE - 1];
+	if (reseed) {
+		seedNoise();
+	}
 
-		const bool invertOldData = (params[INVERT_OLD_DATA_PARAM].getValue() != 0.0f) ||
-								   (inputs[INV_OUT_INPUT].getVoltage() != 0.0f);
-		if (invertOldData) {
-			oldData = (oldData == 1) ? 0 : 1;
-		}
+	// Generate the next noise block for all rings (or start over if rings were added).
+	if (noisePos >= NOISE_BLOCK_SIZE || channels > noiseChannels) {
+		block::noise(noiseLanes, noiseBlock[0], NOISE_BLOCK_SIZE, (channels + 3) / 4 * 4, noiseColour);
+		noisePos = 0;
+		noiseChannels = channels;
+	}
+
+	int multiply, divide;
+	clockRatio.get(multiply, divide);
+
+	// Under CPU pressure, anti-aliasing steps down one mode per level (oversampling, MinBLEP, off).
+	const int mode = std::max(antiAliasing - static_cast<int>(adaptiveQuality.getLevel()), 0);
+	const int oversample = (mode == OVERSAMPLED_ANTI_ALIASING) ? OVERSAMPLE : 1;
+
+	// At most one step every two (sub)samples.
+	const float deltaPhase = std::min(freq * args.sampleTime / oversample, 0.5f);
 
-		unsigned int sum(0);
+	// Oversampled DAC outputs of all rings, decimated together after the loop.
+	float nPlus1Buffer[OVERSAMPLE][PORT_MAX_CHANNELS];
+	float twoPowNBuffer[OVERSAMPLE][PORT_MAX_CHANNELS];
 
-		// Advance shift register
-		for (size_t i = SR_SIZE-1; i > 0; i--) {
-			sum += shiftRegister[i];
-			shiftRegister[i] = shiftRegister[i - 1];
+	for (int c = 0; c < channels; c += 4) {
+		const int b = c / 4;
+
+		const simd::float_4 noiseSample = simd::float_4::load(&noiseBlock[noisePos][c]) * 10.0f;
+
+		// Either use Chance input to sample data for Chance comparator or White Noise.
+		simd::float_4 sample = noiseSample;
+		if (extChance) {
+			sample = inputs[EXT_CHANCE_INPUT].getPolyVoltageSimd<simd::float_4>(c);
 		}
 
-		sum += shiftRegister[0];
-
-		// Only do stale data detection if we are not inverting old data.invertOldData
-		// If we are, the shift register should never be stale.
-		if (!invertOldData) {
-			// Stale data detection (either all 0s or all 1s in the shift register).
-			if (sum == 0) {
-				selectNewData = true;
-				newData = 1;
-			} else if (sum == 8) {
-				selectNewData = true;
-				newData = 0;
+		const simd::float_4 clockVoltage = extClock ? inputs[EXT_RATE_INPUT].getPolyVoltageSimd<simd::float_4>(c) : 0.0f;
+		simd::float_4 offset;
+
+		if (mode == OVERSAMPLED_ANTI_ALIASING) {
+			// Run the rings at the oversampled rate, external clock is interpolated linearly.
+			const simd::float_4 startClock = lastClock[b];
+
+			for (int k = 0; k < OVERSAMPLE; k++) {
+				const simd::float_4 subClock = startClock + (clockVoltage - startClock) * ((k + 1.0f) / OVERSAMPLE);
+				const int stepMask = simd::movemask(clockRings(b, subClock, extClock, multiply, divide, deltaPhase, offset));
+				if (stepMask) {
+					stepRings(c, channels, stepMask, noiseSample, sample);
+				}
+				simd::float_4::load(&nPlus1Output[c]).store(&nPlus1Buffer[k][c]);
+				simd::float_4::load(&twoPowNOutput[c]).store(&twoPowNBuffer[k][c]);
+			}
+		} else {
+			const int stepMask = simd::movemask(clockRings(b, clockVoltage, extClock, multiply, divide, deltaPhase, offset));
+			if (stepMask) {
+				const simd::float_4 lastNPlus1 = simd::float_4::load(&nPlus1Output[c]);
+				const simd::float_4 lastTwoPowN = simd::float_4::load(&twoPowNOutput[c]);
+
+				stepRings(c, channels, stepMask, noiseSample, sample);
+
+				if (mode == MINBLEP_ANTI_ALIASING) {
+					// Band-limit each DAC transition at the exact time of its step.
+					const simd::float_4 nPlus1Jump = simd::float_4::load(&nPlus1Output[c]) - lastNPlus1;
+					const simd::float_4 twoPowNJump = simd::float_4::load(&twoPowNOutput[c]) - lastTwoPowN;
+					for (int i = 0; i < 4; i++) {
+						if (stepMask & (1 << i)) {
+							const simd::float_4 lane = simd::movemaskInverse<simd::float_4>(1 << i);
+							nPlus1Blep[b].insertDiscontinuity(offset[i], lane & nPlus1Jump);
+							twoPowNBlep[b].insertDiscontinuity(offset[i], lane & twoPowNJump);
+						}
+					}
+				}
+			}
+
+			simd::float_4 nPlus1 = simd::float_4::load(&nPlus1Output[c]);
+			simd::float_4 twoPowN = simd::float_4::load(&twoPowNOutput[c]);
+			if (mode == MINBLEP_ANTI_ALIASING) {
+				nPlus1 += nPlus1Blep[b].process();
+				twoPowN += twoPowNBlep[b].process();
 			}
+			outputs[N_PLUS_1_OUTPUT].setVoltageSimd(nPlus1, c);
+			outputs[TWO_POW_N_OUTPUT].setVoltageSimd(twoPowN, c);
 		}
 
-		// Move data into shift register
-		shiftRegister[0] = (selectNewData) ? newData : oldData;
+		lastClock[b] = clockVoltage;
+		outputs[NOISE_OUTPUT].setVoltageSimd(noiseSample, c);
+	}
 
-#ifdef DEBUG_MODE
-		for (size_t i = 0; i < SR_SIZE; ++i) {
-			debug("%d %d", i, shiftRegister[i]);
+	if (mode == OVERSAMPLED_ANTI_ALIASING) {
+		const int lanes = (channels + 3) / 4 * 4;
+		float nPlus1[PORT_MAX_CHANNELS];
+		float twoPowN[PORT_MAX_CHANNELS];
+		block::decimate(nPlus1Decimator, nPlus1Buffer[0], lanes, nPlus1);
+		block::decimate(twoPowNDecimator, twoPowNBuffer[0], lanes, twoPowN);
+		for (int c = 0; c < channels; c += 4) {
+			outputs[N_PLUS_1_OUTPUT].setVoltageSimd(simd::float_4::load(&nPlus1[c]), c);
+			outputs[TWO_POW_N_OUTPUT].setVoltageSimd(simd::float_4::load(&twoPowN[c]), c);
 		}
-#endif
 	}
 
-	// DAC
-	float TwoPowNOutput(0.0f);
-	float nPlus1Output(0.0f);
-	for (size_t i = 0; i < SR_SIZE; ++i) {
-		nPlus1Output += (static_cast<float>(shiftRegister[i]) * DAC_MULT1[i]);
-		TwoPowNOutput += (static_cast<float>(shiftRegister[i]) * DAC_MULT2[i]);
-	}
+	outputs[N_PLUS_1_OUTPUT].setChannels(channels);
+	outputs[TWO_POW_N_OUTPUT].setChannels(channels);
+	outputs[NOISE_OUTPUT].setChannels(channels);
 
-	// Outputs
-	outputs[N_PLUS_1_OUTPUT].setVoltage(clamp(nPlus1Output, 0.0f, 10.0f));
-	outputs[TWO_POW_N_OUTPUT].setVoltage(clamp(TwoPowNOutput, 0.0f, 10.0f));
-	outputs[NOISE_OUTPUT].setVoltage(noiseSample);
+	noisePos++;
 }
 
 struct NoseringWidget : ModuleWidget {
 	NoseringWidget(Nosering *module);
+	void appendContextMenu(Menu *menu) override;
 };
 
 NoseringWidget::NoseringWidget(Nosering *module) {
@@ -205,4 +508,43 @@ NoseringWidget::NoseringWidget(Nosering *module) {
 	addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 }
 
+void NoseringWidget::appendContextMenu(Menu *menu) {
+	Nosering *module = dynamic_cast<Nosering*>(this->module);
+
+	menu->addChild(new MenuSeparator);
+
+	std::vector<std::string> lengthLabels;
+	for (int l : SR_LENGTHS) {
+		lengthLabels.push_back(string::f("%d bits", l));
+	}
+	menu->addChild(createIndexSubmenuItem("Shift register length", lengthLabels,
+		[=]() {
+			size_t index = 0;
+			for (size_t i = 0; i < sizeof(SR_LENGTHS) / sizeof(SR_LENGTHS[0]); i++) {
+				if (SR_LENGTHS[i] <= module->getLength()) index = i;
+			}
+			return index;
+		},
+		[=](size_t index) {
+			module->setLength(SR_LENGTHS[index]);
+		}));
+
+	menu->addChild(createIndexSubmenuItem("Anti-aliasing", {"Off", "MinBLEP", "4x oversampling"},
+		[=]() { return module->getAntiAliasing(); },
+		[=](size_t mode) { module->setAntiAliasing(mode); }));
+	menu->addChild(createIndexSubmenuItem("Noise colour", {"White", "Pink", "Brown"},
+		[=]() { return module->getNoiseColour(); },
+		[=](size_t colour) { module->setNoiseColour(colour); }));
+	menu->addChild(createBoolMenuItem("Fixed noise seed", "",
+		[=]() { return module->getSeed() != 0; },
+		[=](bool fixed) { module->setSeed(fixed ? (random::u32() | 1u) : 0u); }));
+
+	menu->addChild(createClockRatioMenuItem(&module->clockRatio));
+	menu->addChild(createControlRateMenuItem(&module->controlRate));
+	menu->addChild(createAdaptiveQualityMenuItem(&module->adaptiveQuality));
+
+	menu->addChild(new MenuSeparator);
+	menu->addChild(createInputCaptureMenuItem(module, &module->inputCapture));
+}
+
 Model *modelNosering = createModel<Nosering, NoseringWidget>("Nosering");
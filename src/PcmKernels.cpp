@@ -0,0 +1,67 @@
+#include "PcmKernels.hpp"
+#include "Cpu.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PCM_KERNELS_X86
+#endif
+
+
+namespace pcm {
+
+// Variants, one translation unit each (PcmKernels<Isa>.cpp).
+#define DECLARE_PCM_KERNELS(variant) \
+	namespace variant { \
+	float absPeak(const float *in, const size_t n); \
+	float convertS16(const int16_t *in, float *out, const size_t n, const float scale); \
+	void summarize(const float *in, const size_t n, float &min, float &max, float &sumSquares); \
+	}
+
+DECLARE_PCM_KERNELS(baseline)
+#ifdef PCM_KERNELS_X86
+DECLARE_PCM_KERNELS(avx2)
+DECLARE_PCM_KERNELS(avx512)
+#endif
+
+namespace {
+
+struct Kernels {
+	float (*absPeak)(const float*, const size_t);
+	float (*convertS16)(const int16_t*, float*, const size_t, const float);
+	void (*summarize)(const float*, const size_t, float&, float&, float&);
+};
+
+Kernels selectKernels() {
+	switch (cpu::selected()) {
+#ifdef PCM_KERNELS_X86
+		case cpu::AVX512_ISA: return {avx512::absPeak, avx512::convertS16, avx512::summarize};
+		case cpu::AVX2_ISA: return {avx2::absPeak, avx2::convertS16, avx2::summarize};
+#endif
+		default: return {baseline::absPeak, baseline::convertS16, baseline::summarize};
+	}
+}
+
+const Kernels &kernels() {
+	static const Kernels selected = selectKernels();
+	return selected;
+}
+
+} // namespace
+
+
+float absPeak(const float *in, const size_t n) {
+	return kernels().absPeak(in, n);
+}
+
+float convertS16(const int16_t *in, float *out, const size_t n, const float scale) {
+	return kernels().convertS16(in, out, n, scale);
+}
+
+void summarize(const float *in, const size_t n, float &min, float &max, float &sumSquares) {
+	kernels().summarize(in, n, min, max, sumSquares);
+}
+
+const char *kernelName() {
+	return cpu::name(cpu::selected());
+}
+
+} // namespace pcm
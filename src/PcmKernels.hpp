@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Vectorized PCM conversion and peak detection used by the audio loaders.
+// The best ISA variant for the host CPU is selected at runtime (see Cpu.hpp).
+namespace pcm {
+
+// Largest absolute sample value in `in`.
+float absPeak(const float *in, const size_t n);
+
+// Convert signed 16 bit samples to float (multiplied by `scale`) and return the
+// largest absolute converted value, all in one pass.
+float convertS16(const int16_t *in, float *out, const size_t n, const float scale);
+
+// Minimum, maximum and sum of squares of `in` (all 0 if empty).
+void summarize(const float *in, const size_t n, float &min, float &max, float &sumSquares);
+
+// Name of the selected implementation (for logging).
+const char *kernelName();
+
+} // namespace pcm
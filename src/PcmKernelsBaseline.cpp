@@ -0,0 +1,3 @@
+// Baseline variant of the PCM kernels, built with the flags of Rack.
+#define PCM_KERNELS_NAMESPACE baseline
+#include "PcmKernelsImpl.hpp"
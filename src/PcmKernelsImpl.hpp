@@ -0,0 +1,227 @@
+// PCM kernels, compiled once per ISA variant. Each PcmKernels<Isa>.cpp defines
+// PCM_KERNELS_NAMESPACE and includes this file; the code paths follow the
+// compiler flags of that file (see Makefile).
+//
+// No std:: templates here: their out-of-line copies would be merged across
+// variants by the linker and could run on a CPU that lacks the instructions.
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__AVX512F__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef PCM_KERNELS_NAMESPACE
+#error "Define PCM_KERNELS_NAMESPACE before including PcmKernelsImpl.hpp"
+#endif
+
+
+namespace pcm {
+namespace PCM_KERNELS_NAMESPACE {
+
+namespace {
+
+inline float absf(const float x) {
+	return (x < 0.0f) ? -x : x;
+}
+
+inline float maxf(const float a, const float b) {
+	return (a < b) ? b : a;
+}
+
+inline float minf(const float a, const float b) {
+	return (b < a) ? b : a;
+}
+
+#if defined(__SSE2__) && !defined(__AVX512F__)
+inline float horizontalMax(const __m128 v) {
+	__m128 m = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+inline float horizontalMin(const __m128 v) {
+	__m128 m = _mm_min_ps(v, _mm_movehl_ps(v, v));
+	m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+	return _mm_cvtss_f32(m);
+}
+
+inline float horizontalSum(const __m128 v) {
+	__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+#endif
+
+#if defined(__AVX2__) && !defined(__AVX512F__)
+inline __m128 lowHalf(const __m256 v) {
+	return _mm256_castps256_ps128(v);
+}
+
+inline __m128 highHalf(const __m256 v) {
+	return _mm256_extractf128_ps(v, 1);
+}
+#endif
+
+} // namespace
+
+
+float absPeak(const float *in, const size_t n) {
+	float peak = 0.0f;
+	size_t i = 0;
+
+#if defined(__AVX512F__)
+	__m512 peak0 = _mm512_setzero_ps();
+	__m512 peak1 = _mm512_setzero_ps();
+	for (; i + 32 <= n; i += 32) {
+		peak0 = _mm512_max_ps(peak0, _mm512_abs_ps(_mm512_loadu_ps(in + i)));
+		peak1 = _mm512_max_ps(peak1, _mm512_abs_ps(_mm512_loadu_ps(in + i + 16)));
+	}
+	peak = _mm512_reduce_max_ps(_mm512_max_ps(peak0, peak1));
+#elif defined(__AVX2__)
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 peak0 = _mm256_setzero_ps();
+	__m256 peak1 = _mm256_setzero_ps();
+	for (; i + 16 <= n; i += 16) {
+		peak0 = _mm256_max_ps(peak0, _mm256_and_ps(_mm256_loadu_ps(in + i), absMask));
+		peak1 = _mm256_max_ps(peak1, _mm256_and_ps(_mm256_loadu_ps(in + i + 8), absMask));
+	}
+	const __m256 peakV = _mm256_max_ps(peak0, peak1);
+	peak = horizontalMax(_mm_max_ps(lowHalf(peakV), highHalf(peakV)));
+#elif defined(__SSE2__)
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 peak0 = _mm_setzero_ps();
+	__m128 peak1 = _mm_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		peak0 = _mm_max_ps(peak0, _mm_and_ps(_mm_loadu_ps(in + i), absMask));
+		peak1 = _mm_max_ps(peak1, _mm_and_ps(_mm_loadu_ps(in + i + 4), absMask));
+	}
+	peak = horizontalMax(_mm_max_ps(peak0, peak1));
+#endif
+
+	for (; i < n; ++i) {
+		peak = maxf(peak, absf(in[i]));
+	}
+	return peak;
+}
+
+float convertS16(const int16_t *in, float *out, const size_t n, const float scale) {
+	float peak = 0.0f;
+	size_t i = 0;
+
+#if defined(__AVX512F__)
+	const __m512 scaleV = _mm512_set1_ps(scale);
+	__m512 peakV = _mm512_setzero_ps();
+	for (; i + 32 <= n; i += 32) {
+		const __m512i lo = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+		const __m512i hi = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16)));
+		const __m512 f0 = _mm512_mul_ps(_mm512_cvtepi32_ps(lo), scaleV);
+		const __m512 f1 = _mm512_mul_ps(_mm512_cvtepi32_ps(hi), scaleV);
+		_mm512_storeu_ps(out + i, f0);
+		_mm512_storeu_ps(out + i + 16, f1);
+		peakV = _mm512_max_ps(peakV, _mm512_max_ps(_mm512_abs_ps(f0), _mm512_abs_ps(f1)));
+	}
+	peak = _mm512_reduce_max_ps(peakV);
+#elif defined(__AVX2__)
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 scaleV = _mm256_set1_ps(scale);
+	__m256 peakV = _mm256_setzero_ps();
+	for (; i + 16 <= n; i += 16) {
+		const __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+		const __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 8)));
+		const __m256 f0 = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scaleV);
+		const __m256 f1 = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scaleV);
+		_mm256_storeu_ps(out + i, f0);
+		_mm256_storeu_ps(out + i + 8, f1);
+		peakV = _mm256_max_ps(peakV, _mm256_max_ps(_mm256_and_ps(f0, absMask), _mm256_and_ps(f1, absMask)));
+	}
+	peak = horizontalMax(_mm_max_ps(lowHalf(peakV), highHalf(peakV)));
+#elif defined(__SSE2__)
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 scaleV = _mm_set1_ps(scale);
+	__m128 peakV = _mm_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		const __m128i s16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		// Sign extend to 32 bit by unpacking into the upper half and shifting down.
+		const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s16, s16), 16);
+		const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s16, s16), 16);
+		const __m128 f0 = _mm_mul_ps(_mm_cvtepi32_ps(lo), scaleV);
+		const __m128 f1 = _mm_mul_ps(_mm_cvtepi32_ps(hi), scaleV);
+		_mm_storeu_ps(out + i, f0);
+		_mm_storeu_ps(out + i + 4, f1);
+		peakV = _mm_max_ps(peakV, _mm_max_ps(_mm_and_ps(f0, absMask), _mm_and_ps(f1, absMask)));
+	}
+	peak = horizontalMax(peakV);
+#endif
+
+	for (; i < n; ++i) {
+		out[i] = static_cast<float>(in[i]) * scale;
+		peak = maxf(peak, absf(out[i]));
+	}
+	return peak;
+}
+
+void summarize(const float *in, const size_t n, float &min, float &max, float &sumSquares) {
+	if (n == 0) {
+		min = max = sumSquares = 0.0f;
+		return;
+	}
+	float lo = in[0];
+	float hi = in[0];
+	float sum = 0.0f;
+	size_t i = 0;
+
+#if defined(__AVX512F__)
+	__m512 loV = _mm512_set1_ps(in[0]);
+	__m512 hiV = loV;
+	__m512 sumV = _mm512_setzero_ps();
+	for (; i + 16 <= n; i += 16) {
+		const __m512 x = _mm512_loadu_ps(in + i);
+		loV = _mm512_min_ps(loV, x);
+		hiV = _mm512_max_ps(hiV, x);
+		sumV = _mm512_fmadd_ps(x, x, sumV);
+	}
+	lo = _mm512_reduce_min_ps(loV);
+	hi = _mm512_reduce_max_ps(hiV);
+	sum = _mm512_reduce_add_ps(sumV);
+#elif defined(__AVX2__)
+	__m256 loV = _mm256_set1_ps(in[0]);
+	__m256 hiV = loV;
+	__m256 sumV = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		const __m256 x = _mm256_loadu_ps(in + i);
+		loV = _mm256_min_ps(loV, x);
+		hiV = _mm256_max_ps(hiV, x);
+		sumV = _mm256_fmadd_ps(x, x, sumV);
+	}
+	lo = horizontalMin(_mm_min_ps(lowHalf(loV), highHalf(loV)));
+	hi = horizontalMax(_mm_max_ps(lowHalf(hiV), highHalf(hiV)));
+	sum = horizontalSum(_mm_add_ps(lowHalf(sumV), highHalf(sumV)));
+#elif defined(__SSE2__)
+	__m128 loV = _mm_set1_ps(in[0]);
+	__m128 hiV = loV;
+	__m128 sumV = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		const __m128 x = _mm_loadu_ps(in + i);
+		loV = _mm_min_ps(loV, x);
+		hiV = _mm_max_ps(hiV, x);
+		sumV = _mm_add_ps(sumV, _mm_mul_ps(x, x));
+	}
+	lo = horizontalMin(loV);
+	hi = horizontalMax(hiV);
+	sum = horizontalSum(sumV);
+#endif
+
+	for (; i < n; ++i) {
+		lo = minf(lo, in[i]);
+		hi = maxf(hi, in[i]);
+		sum += in[i] * in[i];
+	}
+	min = lo;
+	max = hi;
+	sumSquares = sum;
+}
+
+} // namespace PCM_KERNELS_NAMESPACE
+} // namespace pcm
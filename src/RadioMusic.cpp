@@ -2,18 +2,48 @@
 
 #include <thread>
 #include <condition_variable>
+#include <ctime>
 
 #include "osdialog.h"
 
+#include "AdaptiveQuality.hpp"
+#include "BlockKernels.hpp"
+#include "CompressedSamples.hpp"
+#include "ControlRate.hpp"
+#include "Crossfade.hpp"
+#include "FastMath.hpp"
+#include "InputCapture.hpp"
+#include "Instrumentation.hpp"
+#include "PcmKernels.hpp"
+#include "RtSafety.hpp"
+#include "SampleArena.hpp"
+#include "SpscQueue.hpp"
+
 #define DR_WAV_IMPLEMENTATION
 #include "dep/dr_libs/dr_wav.h"
+#define DR_FLAC_IMPLEMENTATION
+#include "dep/dr_libs/dr_flac.h"
+#define DR_MP3_IMPLEMENTATION
+#include "dep/dr_libs/dr_mp3.h"
 
 #define MAX_BANK_SIZE 2147483648l // 2GB max per bank (in memory!)
 #define MAX_NUM_BANKS 16
 #define MAX_DIR_DEPTH 1
+#define MAX_LOAD_THREADS 4
+#define LOAD_CHUNK_FRAMES 65536 // Frames decoded per chunk while loading
+#define COMMAND_QUEUE_SIZE 64
+#define RENDER_BLOCK_SIZE 16
+#define DECODE_POLL_MS 10 // Fallback for missed wakeups of the block decoder
+#define SWAP_POLL_MS 10 // Fallback for missed wakeups of the worker after a pool swap
+#define STATS_DIR "modular80-stats" // In the Rack user folder
 
 #define PITCH_MODE_DEFAULT 0.5f
 #define NORMAL_MODE_DEFAULT 0.0f
+#define METER_MINIMAL_DIVISION 4 // Control frames per VU meter update at minimal quality
+#define REDUCED_CROSSFADE_DURATION 0.005f // Longest crossfade at reduced quality
+
+// Gains of the fade out decay for each frame of a render block.
+static constexpr fastmath::Table<RENDER_BLOCK_SIZE> FADEOUT_DECAY = fastmath::powTable<RENDER_BLOCK_SIZE>(1.0f - 0.05f); // 0.05 = ~5ms
 
 
 class FileScanner {
@@ -33,10 +63,12 @@ void reset() {
 static bool isSupportedAudioFormat(std::string& path) {
 	const std::string tmpF = string::lowercase(path);
 	return (string::endsWith(tmpF, ".wav") ||
-			string::endsWith(tmpF, ".raw"));
+			string::endsWith(tmpF, ".raw") ||
+			string::endsWith(tmpF, ".flac") ||
+			string::endsWith(tmpF, ".mp3"));
 }
 
-void scan(std::string& root, const bool sort = false, const bool filter = true) {
+void scan(const std::string& root, const bool sort = false, const bool filter = true) {
 
 	std::vector<std::string> files;
 	std::vector<std::string> entries;
@@ -91,6 +123,119 @@ std::vector< std::vector<std::string> > banks;
 };
 
 
+// Multi-resolution min/max/RMS summary of an audio object, used for drawing
+// the waveform at any zoom level without touching the sample data.
+struct WaveformOverview {
+	struct Bucket {
+		float min;
+		float max;
+		float meanSquare;
+	};
+
+	// Number of frames summarized by each bucket of the finest level.
+	// Every following level halves the resolution of the previous one.
+	static const size_t BASE_BUCKET_FRAMES = 256;
+
+	std::vector< std::vector<Bucket> > levels;
+	size_t totalFrames = 0;
+
+	void build(const float *samples, const size_t numFrames, const unsigned int channels) {
+		levels.clear();
+		totalFrames = numFrames;
+
+		if (!samples || numFrames == 0 || channels == 0) {
+			return;
+		}
+
+		// Finest level from the sample data (all channels folded together).
+		std::vector<Bucket> base((numFrames + BASE_BUCKET_FRAMES - 1) / BASE_BUCKET_FRAMES);
+		for (size_t b = 0; b < base.size(); ++b) {
+			const size_t start = b * BASE_BUCKET_FRAMES;
+			const size_t end = std::min(start + BASE_BUCKET_FRAMES, numFrames);
+
+			Bucket bucket;
+			pcm::summarize(samples + start * channels, (end - start) * channels, bucket.min, bucket.max, bucket.meanSquare);
+			bucket.meanSquare /= (end - start) * channels;
+			base[b] = bucket;
+		}
+		levels.push_back(std::move(base));
+
+		// Coarser levels by merging pairs of buckets.
+		while (levels.back().size() > 1) {
+			const std::vector<Bucket> &prev = levels.back();
+			std::vector<Bucket> next((prev.size() + 1) / 2);
+			for (size_t b = 0; b < next.size(); ++b) {
+				const Bucket &a = prev[2 * b];
+				if (2 * b + 1 < prev.size()) {
+					const Bucket &c = prev[2 * b + 1];
+					next[b] = {std::min(a.min, c.min), std::max(a.max, c.max), 0.5f * (a.meanSquare + c.meanSquare)};
+				} else {
+					next[b] = a;
+				}
+			}
+			levels.push_back(std::move(next));
+		}
+	}
+
+	// Summarize the frames in [startFrame, endFrame) from the coarsest level
+	// that still resolves the range, so the cost is independent of its length.
+	Bucket summarize(size_t startFrame, size_t endFrame) const {
+		Bucket result = {0.0f, 0.0f, 0.0f};
+		if (levels.empty() || startFrame >= totalFrames) {
+			return result;
+		}
+		endFrame = std::min(std::max(endFrame, startFrame + 1), totalFrames);
+
+		size_t level = 0;
+		while (level + 1 < levels.size() && (BASE_BUCKET_FRAMES << (level + 1)) <= endFrame - startFrame) {
+			level++;
+		}
+
+		const size_t bucketFrames = BASE_BUCKET_FRAMES << level;
+		const std::vector<Bucket> &buckets = levels[level];
+		const size_t first = startFrame / bucketFrames;
+		const size_t last = std::min((endFrame + bucketFrames - 1) / bucketFrames, buckets.size());
+
+		result = buckets[first];
+		for (size_t b = first + 1; b < last; ++b) {
+			result.min = std::min(result.min, buckets[b].min);
+			result.max = std::max(result.max, buckets[b].max);
+			result.meanSquare += buckets[b].meanSquare;
+		}
+		result.meanSquare /= (last - first);
+
+		return result;
+	}
+
+	size_t memoryUsage() const {
+		size_t bytes = 0;
+		for (const std::vector<Bucket> &level : levels) {
+			bytes += level.size() * sizeof(Bucket);
+		}
+		return bytes;
+	}
+};
+
+
+// Sample memory reserved by the objects of the bank being loaded. Reserved
+// before it is allocated, so decoding stops at MAX_BANK_SIZE.
+struct BankMemory {
+	std::atomic<unsigned long> reserved{0};
+	std::atomic<bool> full{false};
+
+	bool reserve(const unsigned long bytes) {
+		unsigned long used = reserved;
+		do {
+			if (used + bytes >= MAX_BANK_SIZE) {
+				full = true;
+				return false;
+			}
+		} while (!reserved.compare_exchange_weak(used, used + bytes));
+		return true;
+	}
+};
+
+
 // Base class
 class AudioObject {
 
@@ -104,12 +249,37 @@ AudioObject() :
   bytesPerSample(2),
   totalSamples(0),
   samples(nullptr),
-  peak(0.0f) {};
+  peak(0.0f),
+  bankMemory(nullptr) {};
 
 virtual ~AudioObject() {};
 
 virtual bool load(const std::string &path) = 0;
 
+// Replace the decoded samples with their compressed representation
+// (if that actually saves memory).
+void compress() {
+	if (!samples) {
+		return;
+	}
+
+	compressed.encode(samples, totalSamples, channels);
+	if (compressed.memoryUsage() < totalSamples * sizeof(float)) {
+		releaseSamples();
+	} else {
+		compressed.clear();
+	}
+}
+
+bool isCompressed() const {
+	return !compressed.empty();
+}
+
+unsigned long memoryUsage() const {
+	const unsigned long sampleMemory = isCompressed() ? compressed.memoryUsage() : totalSamples * sizeof(float);
+	return sampleMemory + overview.memoryUsage();
+}
+
 std::string filePath;
 float currentPos;
 unsigned int channels;
@@ -118,6 +288,59 @@ unsigned int bytesPerSample;
 drwav_uint64 totalSamples;
 float *samples;
 float peak;
+WaveformOverview overview;
+CompressedSamples compressed;
+
+// Arena of the bank this object belongs to. If set, sample memory is
+// allocated from (and released with) the arena.
+std::shared_ptr<SampleArena> arena;
+
+// If set, sample memory is reserved from the bank's budget first.
+BankMemory *bankMemory;
+
+protected:
+
+float *allocateSamples(const size_t count) {
+	if (count == 0 || (bankMemory && !bankMemory->reserve(sizeof(float) * count))) {
+		return nullptr;
+	}
+	return arena ? arena->allocate(count) : (float*)malloc(sizeof(float) * count);
+}
+
+void releaseSamples() {
+	if (arena) {
+		samples = nullptr;
+	} else {
+		freeSamples();
+	}
+}
+
+// Release memory allocated outside of an arena.
+void freeSamples() {
+	if (samples) {
+		free(samples);
+		samples = nullptr;
+	}
+}
+
+// Decode up to `totalFrames` frames into the samples in chunks, with
+// `read(frames, out)` returning the frames read. The peak is found while each
+// chunk is still in cache. Returns the frames read.
+template <typename Read>
+drwav_uint64 readFrames(const drwav_uint64 totalFrames, Read read) {
+	drwav_uint64 framesRead(0);
+	while (framesRead < totalFrames) {
+		const drwav_uint64 chunkFrames = std::min((drwav_uint64)LOAD_CHUNK_FRAMES, totalFrames - framesRead);
+		float *chunk = samples + framesRead * channels;
+		const drwav_uint64 n = read(chunkFrames, chunk);
+		if (n == 0) {
+			break;
+		}
+		peak = std::max(peak, pcm::absPeak(chunk, n * channels));
+		framesRead += n;
+	}
+	return framesRead;
+}
 
 };
 
@@ -130,27 +353,31 @@ WavAudioObject() : AudioObject() {
 	bytesPerSample = 4;
 };
 ~WavAudioObject() {
-	if (samples) {
-		drwav_free(samples, nullptr);
-	}
+	releaseSamples();
 };
 
 bool load(const std::string &path) override {
-	drwav_uint64 totalFrames(0);
+	drwav wav;
 
 	filePath = path;
-	samples = drwav_open_file_and_read_pcm_frames_f32(
-		filePath.c_str(), &channels, &sampleRate, &totalFrames, nullptr
-	);
+	if (!drwav_init_file(&wav, filePath.c_str(), nullptr)) {
+		return false;
+	}
+
+	channels = wav.channels;
+	sampleRate = wav.sampleRate;
 
-	totalSamples = totalFrames * channels;
+	const drwav_uint64 totalFrames = wav.totalPCMFrameCount;
+	samples = allocateSamples(totalFrames * channels);
 
 	if (samples) {
-		for (size_t i = 0; i < totalSamples; ++i) {
-			if (samples[i] > peak) peak = samples[i];
-		}
+		totalSamples = readFrames(totalFrames, [&wav](drwav_uint64 frames, float *out) {
+			return drwav_read_pcm_frames_f32(&wav, frames, out);
+		}) * channels;
 	}
 
+	drwav_uninit(&wav);
+
 	return (samples != nullptr);
 }
 };
@@ -166,9 +393,7 @@ RawAudioObject() : AudioObject() {
 	bytesPerSample = 2;
 };
 ~RawAudioObject() {
-	if (samples) {
-		free(samples);
-	}
+	releaseSamples();
 }
 
 bool load(const std::string &path) override {
@@ -188,10 +413,9 @@ bool load(const std::string &path) override {
 			if (samplesRead != fsize/(int)bytesPerSample) { WARN("Failed to read entire file"); }
 			totalSamples = samplesRead;
 
-			samples = (float*)malloc(sizeof(float) * totalSamples);
-			for (size_t i = 0; i < totalSamples; ++i) {
-				samples[i] = static_cast<float>(rawSamples[i]);
-				if (samples[i] > peak) peak = samples[i];
+			samples = allocateSamples(totalSamples);
+			if (samples) {
+				peak = pcm::convertS16(rawSamples, samples, totalSamples, 1.0f);
 			}
 		} else {
 			FATAL("Failed to allocate memory");
@@ -209,6 +433,135 @@ bool load(const std::string &path) override {
 };
 
 
+class FlacAudioObject : public AudioObject {
+
+public:
+
+FlacAudioObject() : AudioObject() {
+	bytesPerSample = 4;
+};
+~FlacAudioObject() {
+	releaseSamples();
+};
+
+bool load(const std::string &path) override {
+	filePath = path;
+	drflac *flac = drflac_open_file(filePath.c_str(), nullptr);
+	if (!flac) {
+		return false;
+	}
+
+	channels = flac->channels;
+	sampleRate = flac->sampleRate;
+
+	const drflac_uint64 totalFrames = flac->totalPCMFrameCount;
+	if (totalFrames > 0) {
+		samples = allocateSamples(totalFrames * channels);
+		if (samples) {
+			totalSamples = readFrames(totalFrames, [flac](drflac_uint64 frames, float *out) {
+				return drflac_read_pcm_frames_f32(flac, frames, out);
+			}) * channels;
+		}
+	} else {
+		readUnknownLength(flac);
+	}
+
+	drflac_close(flac);
+
+	return (samples != nullptr);
+}
+
+private:
+
+// Streams without a frame count in their header (e.g. encoded from a pipe):
+// decoded in chunks into a growing buffer, then copied. Stops at the bank
+// size, beyond which the samples couldn't be allocated anyway.
+void readUnknownLength(drflac *flac) {
+	std::vector<float> buffer;
+	drflac_uint64 framesRead(0);
+	while (sizeof(float) * buffer.size() < MAX_BANK_SIZE) {
+		buffer.resize((framesRead + LOAD_CHUNK_FRAMES) * channels);
+		float *chunk = buffer.data() + framesRead * channels;
+		const drflac_uint64 n = drflac_read_pcm_frames_f32(flac, LOAD_CHUNK_FRAMES, chunk);
+		if (n == 0) {
+			break;
+		}
+		peak = std::max(peak, pcm::absPeak(chunk, n * channels));
+		framesRead += n;
+	}
+
+	samples = allocateSamples(framesRead * channels);
+	if (samples) {
+		totalSamples = framesRead * channels;
+		std::copy(buffer.begin(), buffer.begin() + totalSamples, samples);
+	}
+}
+};
+
+
+class Mp3AudioObject : public AudioObject {
+
+public:
+
+Mp3AudioObject() : AudioObject() {
+	bytesPerSample = 4;
+};
+~Mp3AudioObject() {
+	releaseSamples();
+};
+
+bool load(const std::string &path) override {
+	drmp3 mp3;
+
+	filePath = path;
+	if (!drmp3_init_file(&mp3, filePath.c_str(), nullptr)) {
+		return false;
+	}
+
+	channels = mp3.channels;
+	sampleRate = mp3.sampleRate;
+
+	// Scans the frame headers and seeks back to the start.
+	const drmp3_uint64 totalFrames = drmp3_get_pcm_frame_count(&mp3);
+	samples = allocateSamples(totalFrames * channels);
+
+	if (samples) {
+		totalSamples = readFrames(totalFrames, [&mp3](drmp3_uint64 frames, float *out) {
+			return drmp3_read_pcm_frames_f32(&mp3, frames, out);
+		}) * channels;
+	}
+
+	drmp3_uninit(&mp3);
+
+	return (samples != nullptr);
+}
+};
+
+
+// Pick the AudioObject implementation for a file.
+std::shared_ptr<AudioObject> createAudioObject(const std::string &path) {
+	const std::string tmpF = string::lowercase(path);
+	if (string::endsWith(tmpF, ".flac")) {
+		return std::make_shared<FlacAudioObject>();
+	}
+	if (string::endsWith(tmpF, ".mp3")) {
+		return std::make_shared<Mp3AudioObject>();
+	}
+
+	// Quickly determine if file is WAV file
+	drwav wav;
+	if (drwav_init_file(&wav, path.c_str(), nullptr)) {
+		if (drwav_uninit(&wav) != DRWAV_SUCCESS) {
+			FATAL("Failed to uninitialize object %s", path.c_str());
+		}
+		return std::make_shared<WavAudioObject>();
+	}
+
+	// If load fails, interpret as raw audio
+	return std::make_shared<RawAudioObject>();
+}
+
+
 class AudioPlayer {
 
 public:
@@ -220,6 +573,7 @@ AudioPlayer() :
 
 void load(std::shared_ptr<AudioObject> object) {
 	audio = std::move(object);
+	cache.reset((audio && audio->isCompressed()) ? &audio->compressed : nullptr);
 }
 
 void skipTo(float pos) {
@@ -236,8 +590,8 @@ float play(unsigned int channel) {
 			if ((audio->currentPos + channel) < audio->totalSamples) {
 				const unsigned int pos = static_cast<int>(audio->currentPos + channel);
 				const float delta = (audio->currentPos + channel) - pos;
-				sample = crossfade(audio->samples[pos],
-								   audio->samples[std::min(pos+1, (unsigned int)audio->totalSamples-1)],
+				sample = crossfade(sampleAt(pos),
+								   sampleAt(std::min(pos+1, (unsigned int)audio->totalSamples-1)),
 								   delta);
 			}
 		}
@@ -270,6 +624,54 @@ void advance(bool repeat, bool pitchMode) {
 	}
 }
 
+// Renders frames into planar buffers with the given number of channels (1 or
+// 2). Mono files are copied to both channels, stereo files summed to mono.
+void render(float *const *out, const unsigned int outChannels, const int frames, const float gain,
+			const bool repeat, const bool pitchMode) {
+	const bool downmix = audio && outChannels == 1 && audio->channels > 1;
+	const unsigned int lastChannel = audio ? audio->channels - 1 : 0;
+
+	// Have compressed blocks decoded ahead of the play position.
+	if (audio && audio->isCompressed()) {
+		cache.prefetch(static_cast<size_t>(audio->currentPos), static_cast<size_t>(startPos));
+	}
+
+	// Samples in memory: positions of the block first, then each channel in one pass.
+	if (audio && !audio->isCompressed() && frames <= RENDER_BLOCK_SIZE) {
+		float positions[RENDER_BLOCK_SIZE];
+		for (int i = 0; i < frames; i++) {
+			positions[i] = audio->currentPos;
+			advance(repeat, pitchMode);
+		}
+
+		if (downmix) {
+			float left[RENDER_BLOCK_SIZE];
+			float right[RENDER_BLOCK_SIZE];
+			block::interpolate(audio->samples, audio->totalSamples, positions, frames, 0, 1.0f, left);
+			block::interpolate(audio->samples, audio->totalSamples, positions, frames, 1, 1.0f, right);
+			for (int i = 0; i < frames; i++) {
+				out[0][i] = 0.5f * (left[i] + right[i]) * gain;
+			}
+		} else {
+			for (unsigned int c = 0; c < outChannels; c++) {
+				block::interpolate(audio->samples, audio->totalSamples, positions, frames, std::min(c, lastChannel), gain, out[c]);
+			}
+		}
+		return;
+	}
+
+	for (int i = 0; i < frames; i++) {
+		if (downmix) {
+			out[0][i] = 0.5f * (play(0) + play(1)) * gain;
+		} else {
+			for (unsigned int c = 0; c < outChannels; c++) {
+				out[c][i] = play(std::min(c, lastChannel)) * gain;
+			}
+		}
+		advance(repeat, pitchMode);
+	}
+}
+
 void resetTo(float pos) {
 	if (audio) {
 		startPos = pos;
@@ -289,6 +691,7 @@ void reset() {
 	if (audio) {
 		audio.reset();
 	}
+	cache.reset(nullptr);
 }
 
 void setPlaybackSpeed(const float speed) {
@@ -299,22 +702,108 @@ std::shared_ptr<AudioObject> object() {
 	return audio;
 }
 
+SampleBlockCache &blockCache() {
+	return cache;
+}
+
 private:
 
+float sampleAt(const unsigned int pos) {
+	return audio->isCompressed() ? cache.get(pos) : audio->samples[pos];
+}
+
 std::shared_ptr<AudioObject> audio;
 float startPos;
 float playbackSpeed;
+SampleBlockCache cache;
 
 };
 
 
 struct AudioObjectPool {
 	unsigned long memoryUsage = 0;
+	uint32_t generation = 0; // Bank load that filled the pool (0 = none)
 	std::vector<std::shared_ptr<AudioObject>> objects;
+	std::shared_ptr<SampleArena> arena;
 
 	void clear() {
 		objects.clear();
+		arena.reset();
 		memoryUsage = 0;
+		generation = 0;
+	}
+};
+
+
+// Load, render and memory counters of one instance, for finding the cause of
+// glitches. Written by the worker, decode and engine threads, read by the UI.
+struct RadioMusicStats {
+	// Loading (worker and decode threads)
+	instrumentation::Counter filesDecoded;
+	instrumentation::Counter filesFailed;
+	instrumentation::Counter bytesDecoded; // Uncompressed samples
+	instrumentation::Counter decodeNs;
+	instrumentation::Counter banksLoaded;
+	instrumentation::Counter lastLoadNs;
+	instrumentation::Counter loadFinishedNs; // Time stamp for the swap latency
+
+	// Block decoder thread (compressed samples)
+	instrumentation::Counter blocksDecoded;
+	instrumentation::Counter blockDecodeNs;
+
+	// Engine thread
+	instrumentation::Counter poolMemory;
+	instrumentation::Counter poolFiles;
+	instrumentation::Counter poolSwaps;
+	instrumentation::Counter lastSwapLatencyNs;
+	instrumentation::Counter maxSwapLatencyNs;
+	instrumentation::Counter underruns; // Frames without output while a bank is loaded
+	instrumentation::Counter crossfades;
+	instrumentation::Counter fadeOuts;
+	instrumentation::Counter cacheMisses; // Compressed blocks decoded late, on the engine thread
+	instrumentation::Histogram processCycles; // Per process() call
+	instrumentation::Histogram renderCycles;  // Per render block
+
+	double decodeThroughput() const {
+		return (decodeNs.get() > 0) ? 1e9 * bytesDecoded.get() / decodeNs.get() : 0.0;
+	}
+
+	// UI thread. Counts of the engine thread are reset without synchronization:
+	// a count incremented at the same time may survive the reset.
+	void reset() {
+		for (instrumentation::Counter *counter : {&filesDecoded, &filesFailed, &bytesDecoded, &decodeNs, &banksLoaded,
+			&lastLoadNs, &blocksDecoded, &blockDecodeNs, &poolSwaps, &lastSwapLatencyNs, &maxSwapLatencyNs, &underruns,
+			&crossfades, &fadeOuts, &cacheMisses}) {
+			counter->set(0);
+		}
+		processCycles.reset();
+		renderCycles.reset();
+	}
+
+	json_t *toJson() const {
+		json_t *rootJ = json_object();
+		json_object_set_new(rootJ, "filesDecoded", json_integer(filesDecoded.get()));
+		json_object_set_new(rootJ, "filesFailed", json_integer(filesFailed.get()));
+		json_object_set_new(rootJ, "bytesDecoded", json_integer(bytesDecoded.get()));
+		json_object_set_new(rootJ, "decodeSeconds", json_real(decodeNs.get() / 1e9));
+		json_object_set_new(rootJ, "decodeBytesPerSecond", json_real(decodeThroughput()));
+		json_object_set_new(rootJ, "banksLoaded", json_integer(banksLoaded.get()));
+		json_object_set_new(rootJ, "lastLoadSeconds", json_real(lastLoadNs.get() / 1e9));
+		json_object_set_new(rootJ, "blocksDecoded", json_integer(blocksDecoded.get()));
+		json_object_set_new(rootJ, "blockDecodeSeconds", json_real(blockDecodeNs.get() / 1e9));
+		json_object_set_new(rootJ, "poolMemoryBytes", json_integer(poolMemory.get()));
+		json_object_set_new(rootJ, "poolFiles", json_integer(poolFiles.get()));
+		json_object_set_new(rootJ, "poolSwaps", json_integer(poolSwaps.get()));
+		json_object_set_new(rootJ, "lastSwapLatencySeconds", json_real(lastSwapLatencyNs.get() / 1e9));
+		json_object_set_new(rootJ, "maxSwapLatencySeconds", json_real(maxSwapLatencyNs.get() / 1e9));
+		json_object_set_new(rootJ, "underruns", json_integer(underruns.get()));
+		json_object_set_new(rootJ, "crossfades", json_integer(crossfades.get()));
+		json_object_set_new(rootJ, "fadeOuts", json_integer(fadeOuts.get()));
+		json_object_set_new(rootJ, "cacheMisses", json_integer(cacheMisses.get()));
+		json_object_set_new(rootJ, "cycleUnit", json_string(instrumentation::cycleCounterUnit()));
+		json_object_set_new(rootJ, "processCycles", processCycles.toJson());
+		json_object_set_new(rootJ, "renderCycles", renderCycles.toJson());
+		return rootJ;
 	}
 };
 
@@ -330,6 +819,24 @@ struct MsTimer : dsp::TTimer<unsigned long> {
 };
 
 
+// Request from the UI thread, applied by the engine thread.
+struct RadioMusicCommand {
+	enum Type {
+		SET_AUDIO_POOL,   // Scan `path` and load current bank
+		SAVE_BANK,        // Copy current bank to `path` and scan it
+		LOAD_BANK,        // (Re)load current bank
+		CLEAR_BANK,       // Release all audio objects
+		SET_BANK_SELECT,  // Enter/exit bank select mode (`value`)
+		SET_OPTION        // Set `option` to `value`
+	};
+
+	Type type = LOAD_BANK;
+	std::string path;
+	int option = 0;
+	bool value = false;
+};
+
+
 struct RadioMusic : Module {
 	enum ParamIds {
 		STATION_PARAM,
@@ -360,32 +867,68 @@ struct RadioMusic : Module {
 	void onReset(const ResetEvent& e) override;
 	void onAdd(const AddEvent& e) override;
 
+	enum Options {
+		STEREO_OUTPUT_OPTION,
+		PITCH_MODE_OPTION,
+		LOOPING_OPTION,
+		CROSSFADE_OPTION,
+		SORT_FILES_OPTION,
+		ALLOW_ALL_FILES_OPTION,
+		COMPRESS_SAMPLES_OPTION,
+		HUGE_PAGES_OPTION,
+		LOCK_SAMPLE_MEMORY_OPTION,
+		NUM_OPTIONS
+	};
+
+	// UI thread: state changes are queued and applied by the engine thread.
 	void clearCurrentBank();
 	void saveCurrentBankToPatchStorage();
 	void removeAudioPoolFromPatchStorage();
+	void selectAudioPool(const std::string &path);
+	void setBankSelectMode(bool enabled);
+	void reloadCurrentBank();
+	void setOption(Options option, bool value);
+	bool getOption(Options option) const {
+		return optionFlag(option);
+	};
 
 	size_t getNumBanks() const {
-		return scanner.banks.size();
+		return numBanks;
 	};
 	size_t getCurrentObjectPoolSize() const {
-		return currentObjectPool->objects.size();
+		return currentPoolSize;
 	};
 
-	// Context menu
-	bool loadFiles;
-	bool scanFiles;
-	bool selectBank;
-	std::string audioPoolLocation;
+	// Audio object currently playing and its normalized play position (for display).
+	std::shared_ptr<AudioObject> getDisplayObject() const;
+	float getDisplayPosition() const {
+		return displayPosition;
+	};
 
-	// Settings
-	bool stereoOutputMode;
-	bool pitchMode;
-	bool loopingEnabled;
-	bool crossfadeEnabled;
-	bool sortFiles;
-	bool allowAllFiles;
+	// Context menu (UI thread)
+	std::string audioPoolLocation;
+	std::atomic<bool> selectBank;
+
+	// Settings. Only written by the engine thread (or while the engine is locked).
+	std::atomic<bool> stereoOutputMode;
+	std::atomic<bool> pitchMode;
+	std::atomic<bool> loopingEnabled;
+	std::atomic<bool> crossfadeEnabled;
+	std::atomic<bool> sortFiles;
+	std::atomic<bool> allowAllFiles;
+	std::atomic<bool> compressSamples;
+	std::atomic<bool> hugePages;
+	std::atomic<bool> lockSampleMemory;
 	std::string rootDir;
-	int currentBank;
+	std::atomic<int> currentBank;
+	Crossfade crossfade;
+	ControlRate controlRate;
+	AdaptiveQuality adaptiveQuality;
+	InputCapture inputCapture;
+	RadioMusicStats stats;
+
+	// UI thread. Writes the statistics to a new JSON file in the stats folder. Returns its path.
+	std::string writeStats() const;
 
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
@@ -414,6 +957,27 @@ struct RadioMusic : Module {
 		json_t *filesJ = json_boolean(allowAllFiles);
 		json_object_set_new(rootJ, "allowAllFiles", filesJ);
 
+		// Option: Compress Samples
+		json_t *compressJ = json_boolean(compressSamples);
+		json_object_set_new(rootJ, "compressSamples", compressJ);
+
+		// Option: Huge Pages
+		json_t *hugePagesJ = json_boolean(hugePages);
+		json_object_set_new(rootJ, "hugePages", hugePagesJ);
+
+		// Option: Lock Sample Memory
+		json_t *lockJ = json_boolean(lockSampleMemory);
+		json_object_set_new(rootJ, "lockSampleMemory", lockJ);
+
+		// Option: Crossfade Time
+		json_object_set_new(rootJ, "crossfadeDuration", crossfade.toJson());
+
+		// Option: Control Rate
+		json_object_set_new(rootJ, "controlRateDivision", controlRate.toJson());
+
+		// Option: Adaptive Quality
+		json_object_set_new(rootJ, "adaptiveQualityBudget", adaptiveQuality.toJson());
+
 		// Internal state: rootDir
 		json_t *rootDirJ = json_string(rootDir.c_str());
 		json_object_set_new(rootJ, "rootDir", rootDirJ);
@@ -450,6 +1014,27 @@ struct RadioMusic : Module {
 		json_t *filesJ = json_object_get(rootJ, "allowAllFiles");
 		if (filesJ) allowAllFiles = json_boolean_value(filesJ);
 
+		// Option: Compress Samples
+		json_t *compressJ = json_object_get(rootJ, "compressSamples");
+		if (compressJ) compressSamples = json_boolean_value(compressJ);
+
+		// Option: Huge Pages
+		json_t *hugePagesJ = json_object_get(rootJ, "hugePages");
+		if (hugePagesJ) hugePages = json_boolean_value(hugePagesJ);
+
+		// Option: Lock Sample Memory
+		json_t *lockJ = json_object_get(rootJ, "lockSampleMemory");
+		if (lockJ) lockSampleMemory = json_boolean_value(lockJ);
+
+		// Option: Crossfade Time
+		crossfade.fromJson(json_object_get(rootJ, "crossfadeDuration"));
+
+		// Option: Control Rate
+		controlRate.fromJson(json_object_get(rootJ, "controlRateDivision"));
+
+		// Option: Adaptive Quality
+		adaptiveQuality.fromJson(json_object_get(rootJ, "adaptiveQualityBudget"));
+
 		// Internal state: rootDir
 		json_t *rootDirJ = json_object_get(rootJ, "rootDir");
 		if (rootDirJ) rootDir = json_string_value(rootDirJ);
@@ -458,16 +1043,30 @@ struct RadioMusic : Module {
 		json_t *bankJ = json_object_get(rootJ, "currentBank");
 		if (bankJ) currentBank = json_integer_value(bankJ);
 
-		scanFiles = true;
+		requestScan(audioPoolLocation);
 	}
 
 private:
 
 	void init();
+	void requestScan(const std::string &path);
+	void processCommands();
+	bool applyCommand(RadioMusicCommand &command);
+	void pushCommand(RadioMusicCommand &&command);
+	void startWorkerJobs();
 	void workerThread();
-	void threadedScan();
+	void decoderThread();
+	void waitForDecoder();
+	void threadedScan(const std::string &path);
+	void threadedSave();
 	void threadedLoad();
 	void resetCurrentPlayer(float start);
+	int clampCurrentBank(int numBanks);
+
+	const std::atomic<bool> &optionFlag(Options option) const;
+	std::atomic<bool> &optionFlag(Options option) {
+		return const_cast<std::atomic<bool>&>(static_cast<const RadioMusic*>(this)->optionFlag(option));
+	};
 
 	FileScanner scanner;
 
@@ -479,44 +1078,98 @@ private:
 
 	AudioObjectPool audioContainer1;
 	AudioObjectPool audioContainer2;
+	AudioObjectPool audioContainer3;
 	AudioObjectPool* currentObjectPool;
 	AudioObjectPool* tmpObjectPool;
+	AudioObjectPool* releaseObjectPool;
 
 	dsp::SchmittTrigger rstButtonTrigger;
 	dsp::SchmittTrigger rstInputTrigger;
 	dsp::PulseGenerator rstLedPulse;
 
 	int prevIndex;
+	float station;
+	float start;
+	float vuPeak;
+	int meterFrames;
 	unsigned long tick;
-	bool crossfade;
 	bool fadeout;
 	float fadeOutGain;
-	float xfadeGain1;
-	float xfadeGain2;
 	bool flashResetLed;
 
 	MsTimer playTimer;
     MsTimer ledTimer;
 
+	// Loading/error indicator
+	bool initTimer;
+	unsigned long timerStart;
+	bool toggle;
+	int numBlinks;
+
 	dsp::VuMeter2 vumeter;
 
 	dsp::SampleRateConverter<2> outputSrc;
+	dsp::SampleRateConverter<2> outputSrcFast; // Reduced quality. Changing the quality of one converter would reallocate.
 	dsp::DoubleRingBuffer<dsp::Frame<2>, 256> outputBuffer;
 
-	const int BLOCK_SIZE = 16;
+	const int BLOCK_SIZE = RENDER_BLOCK_SIZE;
+
+	// UI -> engine thread
+	SpscQueue<RadioMusicCommand, COMMAND_QUEUE_SIZE> commands;
+	dsp::ClockDivider commandDivider;
+
+	// Engine thread (or engine locked)
+	bool hasAudioPool;
+	bool scanFiles;
+	bool loadFiles;
+	bool saveFiles;
+	std::string pendingScanPath;
+	std::string pendingSavePath;
+
+	// Handed over to the worker while its job flag is clear.
+	std::string scanPath;
+	std::string savePath;
 
 	std::mutex mutex;
 	std::condition_variable cond;
 	std::shared_ptr<std::thread> worker;
-	bool stopWorker = false;
-	bool workerDoWork = false;
+	std::atomic<bool> stopWorker{false}; // Stops the decoder too
+
+	// Decodes compressed blocks requested by the players. Holds decodeMutex
+	// while decoding, so taking it waits for blocks in flight.
+	std::mutex decodeMutex;
+	std::condition_variable decodeCond;
+	std::shared_ptr<std::thread> decoder;
+	std::atomic<bool> decodePending{false};
+
+	// Signalled by the engine once it swapped in a loaded pool (filesLoaded clear).
+	std::mutex swapMutex;
+	std::condition_variable swapCond;
 
 	std::atomic<bool> loadingFiles;
 	std::atomic<bool> filesLoaded;
 	std::atomic<bool> abortLoad;
 	std::atomic<bool> scanAudioFiles;
 	std::atomic<bool> loadAudioFiles;
+	std::atomic<bool> saveAudioFiles;
+	std::atomic<bool> releaseObjects;
 	std::atomic<bool> showError;
+
+	std::atomic<size_t> numBanks;
+	std::atomic<size_t> currentPoolSize;
+
+	// Station on display: bank generation << 32 | index (0 = none). Written by the
+	// engine, which doesn't touch shared_ptrs. The UI resolves it from its own
+	// copy of the bank, published by the worker.
+	std::atomic<uint64_t> displayStation;
+	std::atomic<float> displayPosition;
+	uint32_t bankGeneration; // Worker thread
+	mutable std::mutex displayMutex;
+	uint32_t displayGeneration;
+	std::vector<std::shared_ptr<AudioObject>> displayObjects;
+
+	void publishDisplayObjects(const AudioObjectPool &pool);
+	void releaseDisplayObjects(const AudioObjectPool &pool);
 };
 
 // Custom ParamQuantity to handle modal behavior of Start parameter
@@ -564,8 +1217,15 @@ RadioMusic::RadioMusic() {
 	previousPlayer = &audioPlayer2;
 	currentObjectPool = &audioContainer1;
 	tmpObjectPool = &audioContainer2;
+	releaseObjectPool = &audioContainer3;
+	bankGeneration = 0;
+	displayGeneration = 0;
+
+	commandDivider.setDivision(BLOCK_SIZE);
+	outputSrcFast.setQuality(0);
 
 	worker = std::make_shared<std::thread>(&RadioMusic::workerThread, this);
+	decoder = std::make_shared<std::thread>(&RadioMusic::decoderThread, this);
 
 	init();
 }
@@ -573,9 +1233,11 @@ RadioMusic::RadioMusic() {
 RadioMusic::~RadioMusic() {
 	abortLoad = true;
 	stopWorker = true;
-	workerDoWork = true;
 	cond.notify_one();
+	decodeCond.notify_one();
+	swapCond.notify_one();
 	worker->join();
+	decoder->join();
 }
 
 void RadioMusic::onReset(const ResetEvent& e) {
@@ -593,43 +1255,71 @@ void RadioMusic::onAdd(const AddEvent& e) {
 		// No patch storage. Use rootDir (if defined).
 		audioPoolLocation = rootDir;
 	}
-	scanFiles = true;
+	requestScan(audioPoolLocation);
+}
+
+// Only called while the engine is locked (or from the engine thread).
+void RadioMusic::requestScan(const std::string &path) {
+	pendingScanPath = path;
+	hasAudioPool = !path.empty();
+	scanFiles = hasAudioPool;
 }
 
 void RadioMusic::init() {
 	audioPoolLocation = "";
+	hasAudioPool = false;
 	prevIndex = -1;
+	station = 0.0f;
+	start = 0.0f;
+	vuPeak = 0.0f;
+	meterFrames = 0;
 	tick = 0;
-	crossfade = false;
+	crossfade.stop();
 	fadeout = false;
 	fadeOutGain = 1.0f;
-	xfadeGain1 = 0.0f;
-	xfadeGain2 = 1.0f;
 	flashResetLed = false;
 
+	initTimer = true;
+	timerStart = 0;
+	toggle = false;
+	numBlinks = 0;
+
+	displayStation = 0;
+	displayPosition = 0.0f;
+
 	selectBank = false;
 	loadFiles = false;
 	scanFiles = false;
+	saveFiles = false;
 
 	filesLoaded = false;
 	loadingFiles = false;
 	abortLoad = false;
 	scanAudioFiles = false;
 	loadAudioFiles = false;
+	saveAudioFiles = false;
+	releaseObjects = false;
 	showError = false;
 
+	numBanks = 0;
+	currentPoolSize = currentObjectPool->objects.size();
+
 	// Settings
 	stereoOutputMode = false;
 	pitchMode = false;
 	loopingEnabled = true;
 	crossfadeEnabled = true;
+	crossfade.setDuration(CROSSFADE_DEFAULT_DURATION);
 	sortFiles = false;
 	allowAllFiles = false;
+	compressSamples = false;
+	hugePages = false;
+	lockSampleMemory = false;
 	rootDir = "";
 	currentBank = 0;
-
-	// Internal state
-	scanner.banks.clear();
+	controlRate.setDivision(CONTROL_RATE_DEFAULT_DIVISION);
+	controlRate.reset();
+	adaptiveQuality.setBudget(0.0f);
 
 	if (currentPlayer->object()) {
 		currentPlayer->reset();
@@ -643,22 +1333,76 @@ void RadioMusic::init() {
 	}
 }
 
-void RadioMusic::threadedScan() {
-	if (audioPoolLocation.empty()) {
+// Decodes compressed blocks for both players. The engine only reads decoded blocks.
+void RadioMusic::decoderThread() {
+	while (true) {
+		std::unique_lock<std::mutex> lock(decodeMutex);
+		// Signalled without the mutex as well, so poll too.
+		decodeCond.wait_for(lock, std::chrono::milliseconds(DECODE_POLL_MS), [this]() {
+			return stopWorker || decodePending;
+		});
+		if (stopWorker) return;
+		decodePending = false;
+
+		const uint64_t start = instrumentation::nanoseconds();
+		const int blocks = audioPlayer1.blockCache().decode() + audioPlayer2.blockCache().decode();
+		if (blocks > 0) {
+			stats.blocksDecoded.add(blocks);
+			stats.blockDecodeNs.add(instrumentation::nanoseconds() - start);
+		}
+	}
+}
+
+// Worker thread. Once it returns, the decoder no longer reads objects the
+// players were reset from, and their pool can be cleared.
+void RadioMusic::waitForDecoder() {
+	std::lock_guard<std::mutex> lock(decodeMutex);
+}
+
+void RadioMusic::threadedScan(const std::string &path) {
+	if (path.empty()) {
 		WARN("No root directory defined. Scan failed.");
 		showError = true;
 		return;
 	}
 
 	scanner.reset();
-	scanner.scan(audioPoolLocation, sortFiles, !allowAllFiles);
+	scanner.scan(path, sortFiles, !allowAllFiles);
+	numBanks = scanner.banks.size();
 	if (scanner.banks.size() == 0) {
 		return;
 	}
 
-	currentBank = clamp(currentBank, 0, (int)scanner.banks.size()-1);
+	clampCurrentBank(scanner.banks.size());
+
+	loadAudioFiles = true;
+}
+
+void RadioMusic::threadedSave() {
+	if (scanner.banks.size() == 0) return;
+
+	if (system::exists(savePath)) {
+		if (!system::removeRecursively(savePath)) {
+			WARN("Failed to remove existing audiopool: %s", savePath.c_str());
+			showError = true;
+			return;
+		}
+	}
+	if (!system::createDirectory(savePath)) {
+		WARN("Creating audiopool failed: %s", savePath.c_str());
+		showError = true;
+		return;
+	};
+
+	for (auto& f : scanner.banks[currentBank]) {
+		if (!system::copy(f, savePath)) {
+			WARN("Failed to copy file: %s", f.c_str());
+			showError = true;
+		}
+	}
 
-	loadFiles = true;
+	// Rescan from the audio pool in Patch Storage.
+	threadedScan(savePath);
 }
 
 // Inspired by Stoermelder-P1 thread handling.
@@ -666,19 +1410,31 @@ void RadioMusic::threadedScan() {
 void RadioMusic::workerThread() {
 	while (true) {
 		std::unique_lock<std::mutex> lock(mutex);
-		cond.wait(lock, std::bind(&RadioMusic::workerDoWork, this));
+		// The engine thread signals without taking the mutex, so a wakeup can be
+		// missed. Poll the job flags as well.
+		cond.wait_for(lock, std::chrono::milliseconds(50), [this]() {
+			return stopWorker || releaseObjects || saveAudioFiles || scanAudioFiles || loadAudioFiles;
+		});
 		if (stopWorker) return;
 
+		if (releaseObjects) {
+			releaseDisplayObjects(*releaseObjectPool);
+			waitForDecoder();
+			releaseObjectPool->clear();
+			releaseObjects = false;
+		}
+		if (saveAudioFiles) {
+			threadedSave();
+			saveAudioFiles = false;
+		}
 		if (scanAudioFiles) {
-			threadedScan();
+			threadedScan(scanPath);
 			scanAudioFiles = false;
 		}
 		if (loadAudioFiles) {
 			threadedLoad();
 			loadAudioFiles = false;
 		}
-
-		workerDoWork = false;
 	}
 }
 
@@ -691,55 +1447,126 @@ void RadioMusic::threadedLoad() {
 
 	loadingFiles = true;
 
-	drwav wav;
+	const int bank = clampCurrentBank(scanner.banks.size());
 
-	currentBank = clamp(currentBank, 0, (int)scanner.banks.size()-1);
+	const std::vector<std::string> files = scanner.banks[bank];
 
-	const std::vector<std::string> files = scanner.banks[currentBank];
-	for (auto &f : files) {
-		std::shared_ptr<AudioObject> object;
+	// Uncompressed samples of the bank are allocated from one arena.
+	if (!compressSamples) {
+		SampleArena::Options options;
+		options.hugePages = hugePages;
+		options.lockMemory = lockSampleMemory;
+		tmpObjectPool->arena = std::make_shared<SampleArena>(options);
+	}
 
-		// Quickly determine if file is WAV file
-		if (drwav_init_file(&wav, f.c_str(), nullptr)) {
-			object = std::make_shared<WavAudioObject>();
-			if (drwav_uninit(&wav) != DRWAV_SUCCESS) {
-				FATAL("Failed to uninitialize object %s", f.c_str());
+	// Decode files in parallel. Each object keeps its position in the bank.
+	std::vector< std::shared_ptr<AudioObject> > objects(files.size());
+	std::atomic<size_t> nextFile(0);
+	std::atomic<unsigned long> decodedMemory(0);
+	BankMemory bankMemory;
+
+	auto decodeFiles = [&]() {
+		size_t i;
+		while (!abortLoad && !bankMemory.full && (i = nextFile++) < files.size()) {
+			std::shared_ptr<AudioObject> object = createAudioObject(files[i]);
+			object->arena = tmpObjectPool->arena;
+			// Compressed banks are limited by their compressed size instead.
+			object->bankMemory = compressSamples ? nullptr : &bankMemory;
+
+			// Actually load files
+			const bool loaded = object->load(files[i]);
+			object->bankMemory = nullptr;
+			if (bankMemory.full) {
+				break;
 			}
-		} else { // if load fails, interpret as raw audio
-			object = std::make_shared<RawAudioObject>();
-		}
-
-		// Actually load files
-		if (object->load(f)) {
-			// Abort the current load process and release the memory.
-			if (abortLoad) {
-				tmpObjectPool->clear();
-				loadingFiles = false;
-				return;
+			if (!loaded) {
+				WARN("Failed to load object %s", files[i].c_str());
+				showError = true;
+				stats.filesFailed.add();
+				continue;
 			}
 
-			const unsigned long memory = object->totalSamples*sizeof(float);
-			if ((tmpObjectPool->memoryUsage + memory) < MAX_BANK_SIZE) {
-				tmpObjectPool->objects.push_back(std::move(object));
-				tmpObjectPool->memoryUsage += memory;
-			} else {
-				WARN("Bank memory limit of %ld Bytes exceeded. Aborting loading of audio objects.", (long int)MAX_BANK_SIZE);
-				showError = true;
-				break;
+			// Waveform summary for the display is built here, off the audio thread.
+			object->overview.build(object->samples, object->totalSamples / object->channels, object->channels);
+
+			decodedMemory += object->totalSamples * sizeof(float);
+			stats.filesDecoded.add();
+			stats.bytesDecoded.add(object->totalSamples * sizeof(float));
+			if (compressSamples) {
+				object->compress();
+				if (!bankMemory.reserve(object->memoryUsage())) {
+					break;
+				}
 			}
-		} else {
-			WARN("Failed to load object %s", f.c_str());
-			showError = true;
+
+			objects[i] = std::move(object);
+		}
+	};
+
+	const double loadStart = system::getTime();
+
+	const int numThreads = clamp((int)std::thread::hardware_concurrency() - 1, 1, MAX_LOAD_THREADS);
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; t++) {
+		threads.emplace_back(decodeFiles);
+	}
+	decodeFiles();
+	for (std::thread &t : threads) {
+		t.join();
+	}
+
+	const double loadTime = system::getTime() - loadStart;
+	stats.decodeNs.add(1e9 * loadTime);
+	if (loadTime > 0.0) {
+		INFO("Decoded bank %d: %lu Bytes in %.3f s (%.2f GB/s, %s kernels)", bank, (unsigned long)decodedMemory,
+			loadTime, decodedMemory / loadTime / 1e9, pcm::kernelName());
+	}
+
+	// Abort the current load process and release the memory.
+	if (abortLoad) {
+		tmpObjectPool->clear();
+		loadingFiles = false;
+		return;
+	}
+
+	if (bankMemory.full) {
+		WARN("Bank memory limit of %ld Bytes exceeded. Aborting loading of audio objects.", (long int)MAX_BANK_SIZE);
+		showError = true;
+	}
+
+	for (std::shared_ptr<AudioObject> &object : objects) {
+		if (object) {
+			tmpObjectPool->memoryUsage += object->memoryUsage();
+			tmpObjectPool->objects.push_back(std::move(object));
 		}
 	}
+	objects.clear();
+
+	if (compressSamples && decodedMemory > 0) {
+		INFO("Compressed bank %d to %lu of %lu Bytes (%.1f%%)", bank, tmpObjectPool->memoryUsage, (unsigned long)decodedMemory,
+			100.0 * tmpObjectPool->memoryUsage / decodedMemory);
+	}
 
+	stats.banksLoaded.add();
+	stats.lastLoadNs.set(1e9 * loadTime);
+	stats.loadFinishedNs.set(instrumentation::nanoseconds());
+	tmpObjectPool->generation = ++bankGeneration;
+	publishDisplayObjects(*tmpObjectPool);
 	filesLoaded = true;
 
-	while(filesLoaded) {
-		// Wait for object audio pool pointers to be swapped (in main thread).
+	// Wait for object audio pool pointers to be swapped (in main thread). It
+	// signals without the mutex, so poll too. Sleeps while the module is bypassed.
+	{
+		std::unique_lock<std::mutex> lock(swapMutex);
+		while (filesLoaded && !stopWorker) {
+			swapCond.wait_for(lock, std::chrono::milliseconds(SWAP_POLL_MS));
+		}
 	}
 
-	// After swap, release memory of previous audio object pool.
+	// After swap, release memory of previous audio object pool (and its arena).
+	// Without swap (load aborted), this is the new pool.
+	releaseDisplayObjects(*tmpObjectPool);
+	waitForDecoder();
 	tmpObjectPool->clear();
 
 	loadingFiles = false;
@@ -753,6 +1580,44 @@ void RadioMusic::resetCurrentPlayer(float start) {
 	currentPlayer->resetTo(pos);
 }
 
+std::shared_ptr<AudioObject> RadioMusic::getDisplayObject() const {
+	const uint64_t station = displayStation;
+	if (station == 0) {
+		return nullptr;
+	}
+
+	const uint32_t generation = station >> 32;
+	const size_t index = station & 0xffffffff;
+	std::lock_guard<std::mutex> lock(displayMutex);
+	if (generation != displayGeneration || index >= displayObjects.size()) {
+		return nullptr;
+	}
+	return displayObjects[index];
+}
+
+// Worker thread. Before the engine can display stations of the pool.
+void RadioMusic::publishDisplayObjects(const AudioObjectPool &pool) {
+	std::lock_guard<std::mutex> lock(displayMutex);
+	displayGeneration = pool.generation;
+	displayObjects = pool.objects;
+}
+
+// Worker thread. Before the pool is cleared, so its memory is released with it.
+void RadioMusic::releaseDisplayObjects(const AudioObjectPool &pool) {
+	std::lock_guard<std::mutex> lock(displayMutex);
+	if (pool.generation != 0 && pool.generation == displayGeneration) {
+		displayObjects.clear();
+		displayGeneration = 0;
+	}
+}
+
+// Worker thread. The engine increments the bank concurrently, so clamp with a CAS.
+int RadioMusic::clampCurrentBank(int numBanks) {
+	int bank = currentBank;
+	while (!currentBank.compare_exchange_weak(bank, clamp(bank, 0, numBanks - 1))) {}
+	return clamp(bank, 0, numBanks - 1);
+}
+
 void RadioMusic::removeAudioPoolFromPatchStorage() {
 	const std::string audiopool = system::join(getPatchStorageDirectory(), "audiopool");
 	if (system::exists(audiopool)) {
@@ -764,66 +1629,215 @@ void RadioMusic::removeAudioPoolFromPatchStorage() {
 }
 
 void RadioMusic::clearCurrentBank() {
-	if (currentObjectPool) currentObjectPool->clear();
-	if (tmpObjectPool) tmpObjectPool->clear();
-	if (previousPlayer) previousPlayer->reset();
-	if (currentPlayer) currentPlayer->reset();
-
 	// Delete audio pool from patch storage if it exists.
 	removeAudioPoolFromPatchStorage();
 
 	audioPoolLocation = "";
 	rootDir = "";
 
-	for (int i = 0; i < 4; i++) {
-		lights[LED_LIGHT+i].value = 0.0f;
-	}
+	RadioMusicCommand command;
+	command.type = RadioMusicCommand::CLEAR_BANK;
+	pushCommand(std::move(command));
 }
 
 void RadioMusic::saveCurrentBankToPatchStorage() {
-	if (scanner.banks.size() == 0) return;
+	if (getNumBanks() == 0) return;
 
-	std::string audiopool = system::join(getPatchStorageDirectory(), "audiopool");
-	if (system::exists(audiopool)) {
-		if (!system::removeRecursively(audiopool)) {
-			WARN("Failed to remove existing audiopool: %s", audiopool.c_str());
-			showError = true;
-			return;
-		}
+	// Patch Storage is only accessible from the UI thread. Files are copied by the worker.
+	const std::string audiopool = system::join(createPatchStorageDirectory(), "audiopool");
+
+	// Point root directory to audio pool in Patch Storage.
+	audioPoolLocation = audiopool;
+	rootDir = "";
+
+	RadioMusicCommand command;
+	command.type = RadioMusicCommand::SAVE_BANK;
+	command.path = audiopool;
+	pushCommand(std::move(command));
+}
+
+void RadioMusic::selectAudioPool(const std::string &path) {
+	// `rootDir` is saved as a setting.
+	// `audioPoolLocation` defines actual location used.
+	rootDir = path;
+	audioPoolLocation = path;
+
+	RadioMusicCommand command;
+	command.type = RadioMusicCommand::SET_AUDIO_POOL;
+	command.path = path;
+	pushCommand(std::move(command));
+}
+
+void RadioMusic::setBankSelectMode(bool enabled) {
+	RadioMusicCommand command;
+	command.type = RadioMusicCommand::SET_BANK_SELECT;
+	command.value = enabled;
+	pushCommand(std::move(command));
+}
+
+void RadioMusic::reloadCurrentBank() {
+	RadioMusicCommand command;
+	command.type = RadioMusicCommand::LOAD_BANK;
+	pushCommand(std::move(command));
+}
+
+void RadioMusic::setOption(Options option, bool value) {
+	RadioMusicCommand command;
+	command.type = RadioMusicCommand::SET_OPTION;
+	command.option = option;
+	command.value = value;
+	pushCommand(std::move(command));
+}
+
+const std::atomic<bool> &RadioMusic::optionFlag(Options option) const {
+	switch (option) {
+		case STEREO_OUTPUT_OPTION: return stereoOutputMode;
+		case PITCH_MODE_OPTION: return pitchMode;
+		case LOOPING_OPTION: return loopingEnabled;
+		case CROSSFADE_OPTION: return crossfadeEnabled;
+		case SORT_FILES_OPTION: return sortFiles;
+		case ALLOW_ALL_FILES_OPTION: return allowAllFiles;
+		case COMPRESS_SAMPLES_OPTION: return compressSamples;
+		case HUGE_PAGES_OPTION: return hugePages;
+		default: return lockSampleMemory;
 	}
-	audiopool = system::join(createPatchStorageDirectory(), "audiopool");
-	if (!system::createDirectory(audiopool)) {
-		WARN("Creating audiopool failed: %s", audiopool.c_str());
-		showError = true;
-		return;
-	};
+}
 
-	for (auto& f : scanner.banks[currentBank]) {
-		if (!system::copy(f, audiopool)) {
-			WARN("Failed to copy file: %s", f.c_str());
-			showError = true;
+std::string RadioMusic::writeStats() const {
+	const std::string dir = asset::user(STATS_DIR);
+	system::createDirectories(dir);
+
+	char timestamp[32];
+	const std::time_t now = std::time(nullptr);
+	std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+	const std::string path = system::join(dir, string::f("RadioMusic-%s.json", timestamp));
+
+	json_t *rootJ = stats.toJson();
+	json_object_set_new(rootJ, "bank", json_integer(currentBank));
+	json_object_set_new(rootJ, "rootDir", json_string(rootDir.c_str()));
+	json_object_set_new(rootJ, "qualityLevel", json_string(AdaptiveQuality::levelName(adaptiveQuality.getLevel())));
+	json_object_set_new(rootJ, "qualityLevelChanges", json_integer(adaptiveQuality.getChanges()));
+	json_object_set_new(rootJ, "cpuLoad", json_real(adaptiveQuality.getLoad()));
+	const bool written = (json_dump_file(rootJ, path.c_str(), JSON_INDENT(2)) == 0);
+	json_decref(rootJ);
+
+	if (!written) {
+		WARN("Failed to write statistics to %s", path.c_str());
+		return "";
+	}
+	INFO("Statistics written to %s", path.c_str());
+	return path;
+}
+
+void RadioMusic::pushCommand(RadioMusicCommand &&command) {
+	if (!commands.push(std::move(command))) {
+		WARN("Command queue full. Dropping command %d.", (int)command.type);
+	}
+}
+
+// Engine thread. Strings are swapped out of the queue, so nothing is allocated here.
+void RadioMusic::processCommands() {
+	RadioMusicCommand *command;
+	while ((command = commands.front())) {
+		if (!applyCommand(*command)) {
+			// Retry with the next block.
+			break;
 		}
+		commands.pop();
 	}
+}
 
-	// Point root directory to audio pool in Patch Storage and rescan.
-	audioPoolLocation = audiopool;
-	rootDir = "";
-	scanFiles = true;
+bool RadioMusic::applyCommand(RadioMusicCommand &command) {
+	switch (command.type) {
+		case RadioMusicCommand::SET_AUDIO_POOL: {
+			std::swap(pendingScanPath, command.path);
+			hasAudioPool = !pendingScanPath.empty();
+			scanFiles = hasAudioPool;
+		} break;
+		case RadioMusicCommand::SAVE_BANK: {
+			std::swap(pendingSavePath, command.path);
+			hasAudioPool = true;
+			saveFiles = true;
+		} break;
+		case RadioMusicCommand::LOAD_BANK: {
+			loadFiles = true;
+		} break;
+		case RadioMusicCommand::CLEAR_BANK: {
+			// The previous bank is still being released by the worker.
+			if (releaseObjects) {
+				return false;
+			}
+
+			// Drop pending work. A load in progress is discarded.
+			scanFiles = false;
+			loadFiles = false;
+			saveFiles = false;
+			abortLoad = true;
+			hasAudioPool = false;
+
+			currentPlayer->reset();
+			previousPlayer->reset();
+			crossfade.stop();
+			fadeout = false;
+			displayStation = 0;
+			outputBuffer.clear();
+			prevIndex = -1;
+
+			// Memory is released by the worker.
+			std::swap(currentObjectPool, releaseObjectPool);
+			currentPoolSize = 0;
+			stats.poolMemory.set(0);
+			stats.poolFiles.set(0);
+			releaseObjects = true;
+			cond.notify_one();
+
+			for (int i = 0; i < 4; i++) {
+				lights[LED_LIGHT+i].value = 0.0f;
+			}
+			lights[RESET_LIGHT].value = 0.0f;
+			outputs[OUT_OUTPUT].setVoltage(0, 0);
+			outputs[OUT_OUTPUT].setVoltage(0, 1);
+		} break;
+		case RadioMusicCommand::SET_BANK_SELECT: {
+			selectBank = command.value;
+		} break;
+		case RadioMusicCommand::SET_OPTION: {
+			if (command.option >= 0 && command.option < NUM_OPTIONS) {
+				optionFlag(static_cast<Options>(command.option)) = command.value;
+			}
+		} break;
+	}
+	return true;
 }
 
-void RadioMusic::process(const ProcessArgs &args) {
+// Engine thread. Job parameters are handed over while the worker does not use them.
+void RadioMusic::startWorkerJobs() {
+	if (saveFiles) {
+		if (loadingFiles) {
+			abortLoad = true;
+		} else if (!saveAudioFiles && !scanAudioFiles) {
+			std::swap(savePath, pendingSavePath);
+			abortLoad = false;
+			saveAudioFiles = true;
+			cond.notify_one();
 
-	if (audioPoolLocation.empty()) {
-		// No files loaded yet. Idle.
-		return;
+			saveFiles = false;
+			// Saving rescans the new location.
+			scanFiles = false;
+		}
 	}
 
 	if (scanFiles) {
-		scanAudioFiles = true;
-		workerDoWork = true;
-		cond.notify_one();
+		if (loadingFiles) {
+			abortLoad = true;
+		} else if (!scanAudioFiles && !saveAudioFiles) {
+			std::swap(scanPath, pendingScanPath);
+			abortLoad = false;
+			scanAudioFiles = true;
+			cond.notify_one();
 
-		scanFiles = false;
+			scanFiles = false;
+		}
 	}
 
 	if (loadFiles) {
@@ -836,33 +1850,75 @@ void RadioMusic::process(const ProcessArgs &args) {
 			abortLoad = false;
 
 			loadAudioFiles = true;
-			workerDoWork = true;
 			cond.notify_one();
 
 			loadFiles = false;
 		}
 	}
+}
+
+void RadioMusic::process(const ProcessArgs &args) {
+	RT_SAFE_SCOPE("RadioMusic::process");
+	instrumentation::ScopedCycleTimer processTimer(stats.processCycles);
+	AdaptiveQuality::Timer qualityTimer(adaptiveQuality, args);
+
+	inputCapture.process(this, args);
+
+	// Apply UI requests once per block.
+	if (commandDivider.process()) {
+		processCommands();
+	}
+
+	startWorkerJobs();
 
 	if (filesLoaded) {
-		// Swap out Audio Object Pool with newly loaded files
-		AudioObjectPool* tmp;
-		tmp = currentObjectPool;
-		currentObjectPool = tmpObjectPool;
-		tmpObjectPool = tmp;
-		currentPlayer->reset(); // Reset current player to use new audio
-		outputBuffer.clear();   // Clear output buffer to start fresh
-		prevIndex = -1; // Force channel change detection upon loading files
-		playTimer.reset(); // Reset station to beginning
+		// A load finished after its bank was cleared. The worker releases it.
+		if (!abortLoad) {
+			// Swap out Audio Object Pool with newly loaded files
+			AudioObjectPool* tmp;
+			tmp = currentObjectPool;
+			currentObjectPool = tmpObjectPool;
+			tmpObjectPool = tmp;
+			currentPoolSize = currentObjectPool->objects.size();
+			stats.poolMemory.set(currentObjectPool->memoryUsage);
+			stats.poolFiles.set(currentPoolSize);
+			stats.poolSwaps.addSingle();
+			const uint64_t swapLatency = instrumentation::nanoseconds() - stats.loadFinishedNs.get();
+			stats.lastSwapLatencyNs.set(swapLatency);
+			stats.maxSwapLatencyNs.setMax(swapLatency);
+			currentPlayer->reset(); // Reset current player to use new audio
+			previousPlayer->reset(); // Release old audio, so the old pool is freed in one go by the worker
+			crossfade.stop();
+			fadeout = false;
+			displayStation = 0;
+			outputBuffer.clear();   // Clear output buffer to start fresh
+			prevIndex = -1; // Force channel change detection upon loading files
+			playTimer.reset(); // Reset station to beginning
+		}
 
 		filesLoaded = false;
+		swapCond.notify_one();
 	}
 
+	if (!hasAudioPool) {
+		// No files loaded yet. Idle.
+		return;
+	}
+
+	// Knobs, CV and lights are processed at control rate. Reset input stays at audio rate.
+	const bool controlFrame = controlRate.process();
+
+	// Under CPU pressure: shorter crossfades and a cheaper resampler, then fewer VU meter updates.
+	const AdaptiveQuality::Level quality = adaptiveQuality.getLevel();
+
 	// Bank selection mode
-	if (selectBank) {
+	if (selectBank && controlFrame) {
 		// Bank is selected via Reset button
-		if (rstButtonTrigger.process(params[RESET_PARAM].getValue())) {
-			currentBank++;
-			currentBank %= getNumBanks();
+		if (rstButtonTrigger.process(params[RESET_PARAM].getValue()) && getNumBanks() > 0) {
+			// The worker may clamp the bank at the same time.
+			const int banks = static_cast<int>(getNumBanks());
+			int bank = currentBank;
+			while (!currentBank.compare_exchange_weak(bank, (bank + 1) % banks)) {}
 		}
 
 		// Show bank selection in LED bar
@@ -877,25 +1933,30 @@ void RadioMusic::process(const ProcessArgs &args) {
 		ledTimer.process();
 	}
 
-	// Normal mode: Start knob & input
-	float start(0.0f);
-	if (!pitchMode) {
-		start = clamp(params[START_PARAM].getValue() + inputs[START_INPUT].getVoltage()/5.0f, 0.0f, 1.0f);
-	} else {
-		// Pitch mode: Start knob sets sample root pitch (via playback speed). Start input follows 1V/Oct.
-		const float speed = clamp(params[START_PARAM].getValue() + inputs[START_INPUT].getVoltage()/5.0f, 0.0f, 1.0f);
-		const float range = 8.0f;
-		const float scaledSpeed = pow(2.0f, range*speed - range*0.5f);
-		currentPlayer->setPlaybackSpeed(scaledSpeed);
+	if (controlFrame) {
+		// Normal mode: Start knob & input
+		if (!pitchMode) {
+			start = clamp(params[START_PARAM].getValue() + inputs[START_INPUT].getVoltage()/5.0f, 0.0f, 1.0f);
+		} else {
+			// Pitch mode: Start knob sets sample root pitch (via playback speed). Start input follows 1V/Oct.
+			const float speed = clamp(params[START_PARAM].getValue() + inputs[START_INPUT].getVoltage()/5.0f, 0.0f, 1.0f);
+			const float range = 8.0f;
+			const float scaledSpeed = fastmath::exp2(range*speed - range*0.5f);
+			currentPlayer->setPlaybackSpeed(scaledSpeed);
+		}
+
+		// Channel knob & input
+		station = clamp(params[STATION_PARAM].getValue() + inputs[STATION_INPUT].getVoltage()/5.0f, 0.0f, 1.0f);
 	}
 
-	if (getCurrentObjectPoolSize() > 0 && (rstButtonTrigger.process(params[RESET_PARAM].getValue()) ||
+	if (getCurrentObjectPoolSize() > 0 && ((controlFrame && rstButtonTrigger.process(params[RESET_PARAM].getValue())) ||
 		(inputs[RESET_INPUT].isConnected() && rstInputTrigger.process(inputs[RESET_INPUT].getVoltage())))) {
 
 		fadeOutGain = 1.0f;
 
 		if (crossfadeEnabled) {
 			fadeout = true;
+			stats.fadeOuts.addSingle();
 		} else {
 			resetCurrentPlayer(start);
 		}
@@ -905,10 +1966,8 @@ void RadioMusic::process(const ProcessArgs &args) {
 		flashResetLed = true;
 	}
 
-	// Channel knob & input
-	const float channel = clamp(params[STATION_PARAM].getValue() + inputs[STATION_INPUT].getVoltage()/5.0f, 0.0f, 1.0f);
 	const int index = \
-		clamp(static_cast<int>(rescale(channel, 0.0f, 1.0f, 0.0f, static_cast<float>(getCurrentObjectPoolSize()))),
+		clamp(static_cast<int>(rescale(station, 0.0f, 1.0f, 0.0f, static_cast<float>(getCurrentObjectPoolSize()))),
 			0, getCurrentObjectPoolSize() - 1);
 
 	// Channel switch detection
@@ -931,18 +1990,16 @@ void RadioMusic::process(const ProcessArgs &args) {
 			}
 		}
 
-		xfadeGain1 = 0.0f;
-		xfadeGain2 = 1.0f;
-
-		crossfade = crossfadeEnabled;
-
-		if (previousPlayer->object()) {
-			// Different number of channels while crossfading leads to audible artifacts.
-			if (currentPlayer->object()->channels != previousPlayer->object()->channels) {
-				crossfade = false;
-			}
+		// Mono and stereo stations are mixed to the channels of the new one.
+		if (crossfadeEnabled) {
+			crossfade.start();
+			stats.crossfades.addSingle();
+		} else {
+			crossfade.stop();
 		}
 
+		displayStation = (static_cast<uint64_t>(currentObjectPool->generation) << 32) | static_cast<uint32_t>(index);
+
 		flashResetLed = true;
 	}
 
@@ -953,7 +2010,9 @@ void RadioMusic::process(const ProcessArgs &args) {
 		rstLedPulse.trigger(0.050f);
 		flashResetLed = false;
 	}
-	lights[RESET_LIGHT].value = (rstLedPulse.process(args.sampleTime)) ? 1.0f : 0.0f;
+	if (controlFrame) {
+		lights[RESET_LIGHT].value = (rstLedPulse.process(controlRate.sampleTime(args))) ? 1.0f : 0.0f;
+	}
 
 	// Audio processing
 	if (outputBuffer.empty()) {
@@ -962,73 +2021,86 @@ void RadioMusic::process(const ProcessArgs &args) {
 			return;
 		}
 
-		dsp::Frame<2> frame[BLOCK_SIZE];
-
-		for (int i = 0; i < BLOCK_SIZE; i++) {
-
-			// Crossfade?
-			if (crossfade) {
-
-				xfadeGain1 = rack::crossfade(xfadeGain1, 1.0f, 0.005); // 0.005 = ~25ms
-				xfadeGain2 = rack::crossfade(xfadeGain2, 0.0f, 0.005); // 0.005 = ~25ms
-
-				for (size_t channel = 0; channel < currentPlayer->object()->channels; channel++) {
-					const float currSample = currentPlayer->play(channel);
-					const float prevSample = previousPlayer->play(channel);
-					const float out = currSample * xfadeGain1 + prevSample * xfadeGain2;
-
-					frame[i].samples[channel] = 5.0f * out / currentPlayer->object()->peak;
-				}
-
-				currentPlayer->advance(loopingEnabled, pitchMode);
-				previousPlayer->advance(loopingEnabled, pitchMode);
-
-				if (isNear(xfadeGain1+0.005, 1.0f) || isNear(xfadeGain2, 0.0f)) {
-					crossfade = false;
-				}
-
+		instrumentation::ScopedCycleTimer renderTimer(stats.renderCycles);
+
+		// Settings and gains are fixed for the block. Each file is normalized to its own peak.
+		const bool looping = loopingEnabled;
+		const bool pitch = pitchMode;
+		const std::shared_ptr<AudioObject> &object = currentPlayer->object();
+		const unsigned int channels = std::min(object->channels, 2u);
+		const float outputGain = 5.0f / object->peak;
+
+		// Planar blocks of the current and previous station.
+		float current[2][BLOCK_SIZE];
+		float previous[2][BLOCK_SIZE];
+		float *const currentOut[2] = {current[0], current[1]};
+		float *const previousOut[2] = {previous[0], previous[1]};
+
+		if (crossfade.isActive()) {
+			const float previousGain = previousPlayer->object() ? 5.0f / previousPlayer->object()->peak : 0.0f;
+			currentPlayer->render(currentOut, channels, BLOCK_SIZE, outputGain, looping, pitch);
+			previousPlayer->render(previousOut, channels, BLOCK_SIZE, previousGain, looping, pitch);
+
+			float duration = crossfade.getDuration();
+			if (quality >= AdaptiveQuality::REDUCED_QUALITY) {
+				duration = std::min(duration, REDUCED_CROSSFADE_DURATION);
 			}
-			// Fade out (before resetting)?
-			else if (fadeout)
-			{
-
-				fadeOutGain = rack::crossfade(fadeOutGain, 0.0f, 0.05); // 0.05 = ~5ms
-
-				for (size_t channel = 0; channel < currentPlayer->object()->channels; channel++) {
-					const float sample = currentPlayer->play(channel);
-					const float out = sample * fadeOutGain;
-
-					frame[i].samples[channel] = 5.0f * out / currentPlayer->object()->peak;
-				}
-
-				currentPlayer->advance(loopingEnabled, pitchMode);
+			crossfade.process(currentOut, previousOut, channels, BLOCK_SIZE, 1.0f / object->sampleRate, duration);
+		}
+		// Fade out (before resetting)? Decays exponentially, gains are taken from the block table.
+		else if (fadeout) {
+			const float fadeOutStart = fadeOutGain;
 
-				if (isNear(fadeOutGain, 0.0f)) {
+			for (int i = 0; i < BLOCK_SIZE; i++) {
+				float *const frameOut[2] = {current[0] + i, current[1] + i};
 
-					resetCurrentPlayer(start);
+				if (fadeout) {
+					fadeOutGain = fadeOutStart * FADEOUT_DECAY[i];
+					currentPlayer->render(frameOut, channels, 1, outputGain * fadeOutGain, looping, pitch);
 
-					fadeout = false;
+					if (isNear(fadeOutGain, 0.0f)) {
+						resetCurrentPlayer(start);
+						fadeout = false;
+					}
+				} else {
+					currentPlayer->render(frameOut, channels, 1, outputGain, looping, pitch);
 				}
 			}
-			else // Not fade away now!
-			{
-				for (size_t channel = 0; channel < currentPlayer->object()->channels; channel++) {
-					const float out = currentPlayer->play(channel);
+		}
+		else // Not fade away now!
+		{
+			currentPlayer->render(currentOut, channels, BLOCK_SIZE, outputGain, looping, pitch);
+		}
 
-					frame[i].samples[channel] = 5.0f * out / currentPlayer->object()->peak;
-				}
+		// Wake the decoder for newly requested blocks of compressed samples.
+		const unsigned long misses = currentPlayer->blockCache().takeMisses() + previousPlayer->blockCache().takeMisses();
+		if (misses > 0) {
+			stats.cacheMisses.addSingle(misses);
+		}
+		const bool requested = currentPlayer->blockCache().takeRequests() | previousPlayer->blockCache().takeRequests();
+		if (requested && !decodePending.exchange(true)) {
+			decodeCond.notify_one();
+		}
 
-				currentPlayer->advance(loopingEnabled, pitchMode);
+		dsp::Frame<2> frame[BLOCK_SIZE];
+		for (int i = 0; i < BLOCK_SIZE; i++) {
+			for (unsigned int c = 0; c < channels; c++) {
+				frame[i].samples[c] = current[c][i];
 			}
 		}
 
 		// Sample rate conversion to match Rack engine sample rate.
-		outputSrc.setRates(currentPlayer->object()->sampleRate, args.sampleRate);
+		dsp::SampleRateConverter<2> &src = (quality >= AdaptiveQuality::REDUCED_QUALITY) ? outputSrcFast : outputSrc;
+		src.setRates(object->sampleRate, args.sampleRate);
 		int inLen = BLOCK_SIZE;
 		int outLen = outputBuffer.capacity();
 
-		outputSrc.process(frame, &inLen, outputBuffer.endData(), &outLen);
+		src.process(frame, &inLen, outputBuffer.endData(), &outLen);
 		outputBuffer.endIncr(outLen);
+
+		if (currentPlayer->object() && currentPlayer->object()->totalSamples > 0) {
+			displayPosition = currentPlayer->object()->currentPos / currentPlayer->object()->totalSamples;
+		}
 	}
 
 	// Output processing & metering
@@ -1066,12 +2138,20 @@ void RadioMusic::process(const ProcessArgs &args) {
 
 			// Disable VU Meter in Bank Selection mode.
 			if (!selectBank) {
-				vumeter.process(args.sampleTime, frame.samples[0]/5.0f);
-
-				if (ledTimer.elapsedTime() % 16 == 0) {
-					for (int i = 0; i < 4; i++){
-						float b = vumeter.getBrightness(-6.0f * (i+1), 0.0f * i);
-						lights[LED_LIGHT + 3 - i].setBrightness(b);
+				// Peak of the control period, so no transient is missed.
+				vuPeak = std::max(vuPeak, std::fabs(frame.samples[0]));
+
+				const int meterDivision = (quality == AdaptiveQuality::MINIMAL_QUALITY) ? METER_MINIMAL_DIVISION : 1;
+				if (controlFrame && ++meterFrames >= meterDivision) {
+					vumeter.process(meterDivision * controlRate.sampleTime(args), vuPeak/5.0f);
+					vuPeak = 0.0f;
+					meterFrames = 0;
+
+					if (ledTimer.elapsedTime() % 16 == 0) {
+						for (int i = 0; i < 4; i++){
+							float b = vumeter.getBrightness(-6.0f * (i+1), 0.0f * i);
+							lights[LED_LIGHT + 3 - i].setBrightness(b);
+						}
 					}
 				}
 			}
@@ -1079,14 +2159,12 @@ void RadioMusic::process(const ProcessArgs &args) {
 			outputs[OUT_OUTPUT].setVoltage(0, 0);
 			outputs[OUT_OUTPUT].setVoltage(0, 1);
 		}
+	} else if (getCurrentObjectPoolSize() > 0) {
+		stats.underruns.addSingle();
 	}
 
 	// Indicator for loading audio files and errors during load.
 	if (loadingFiles || showError) {
-		static bool initTimer(true);
-		static unsigned long timerStart(0);
-		static bool toggle(false);
-		static int numBlinks(0);
 		unsigned int blinkTime(0);
 
 		if (loadingFiles) {
@@ -1126,13 +2204,8 @@ struct RadioMusicDirDialogItem : MenuItem {
 			rm->rootDir.empty() ? asset::user("") : rm->rootDir;
 		char *path = osdialog_file(OSDIALOG_OPEN_DIR, dir.c_str(), NULL, NULL);
 		if (path) {
-			rm->rootDir = std::string(path);
-
 			// New root directory selected. Scan content.
-			// `rootDir` is saved as a setting.
-			// `audioPoolLocation` defines actual location used.
-			rm->audioPoolLocation = rm->rootDir;
-			rm->scanFiles = true;
+			rm->selectAudioPool(std::string(path));
 
 			// Remove current audiopool in Patch Storage (if it exists).
 			rm->removeAudioPoolFromPatchStorage();
@@ -1146,13 +2219,14 @@ struct RadioMusicSelectBankItem : MenuItem {
 	RadioMusic *rm;
 	int currentBank;
 	void onAction(const ActionEvent &e) override {
-		rm->selectBank = !rm->selectBank;
-		if (rm->selectBank == false) {
+		const bool selectBank = !rm->selectBank;
+		rm->setBankSelectMode(selectBank);
+		if (selectBank == false) {
 			if (currentBank != rm->currentBank) {
 				// Remove current audiopool in Patch Storage (if it exists).
 				rm->removeAudioPoolFromPatchStorage();
 
-				rm->loadFiles = true;
+				rm->reloadCurrentBank();
 			}
 		} else {
 			// When entering bank selection mode, store current bank to detect bank changes.
@@ -1166,6 +2240,77 @@ struct RadioMusicSelectBankItem : MenuItem {
 };
 
 
+// Waveform of the current station with play head. Drawn from the
+// pre-computed overview, so the cost only depends on the display width.
+struct RadioMusicWaveformDisplay : TransparentWidget {
+	RadioMusic *module = nullptr;
+
+	void drawLayer(const DrawArgs &args, int layer) override {
+		if (layer != 1) {
+			return;
+		}
+
+		nvgBeginPath(args.vg);
+		nvgRect(args.vg, 0.0f, 0.0f, box.size.x, box.size.y);
+		nvgFillColor(args.vg, nvgRGBA(0x10, 0x10, 0x10, 0xff));
+		nvgFill(args.vg);
+
+		if (!module) {
+			return;
+		}
+
+		const std::shared_ptr<AudioObject> object = module->getDisplayObject();
+		if (!object || object->overview.totalFrames == 0 || object->peak <= 0.0f) {
+			return;
+		}
+
+		const WaveformOverview &overview = object->overview;
+		const float framesPerPixel = static_cast<float>(overview.totalFrames) / box.size.x;
+		const float centerY = 0.5f * box.size.y;
+		const float scaleY = 0.5f * box.size.y / object->peak;
+
+		NVGcolor peakColor = nvgRGBA(0xc0, 0x20, 0x20, 0xff);
+		NVGcolor rmsColor = nvgRGBA(0xff, 0x60, 0x60, 0xff);
+
+		nvgBeginPath(args.vg);
+		for (int x = 0; x < static_cast<int>(box.size.x); x++) {
+			const WaveformOverview::Bucket bucket = overview.summarize(x * framesPerPixel, (x + 1) * framesPerPixel);
+			const float top = centerY - clamp(bucket.max * scaleY, -centerY, centerY);
+			const float bottom = centerY - clamp(bucket.min * scaleY, -centerY, centerY);
+			nvgRect(args.vg, x, top, 1.0f, std::max(bottom - top, 1.0f));
+		}
+		nvgFillColor(args.vg, peakColor);
+		nvgFill(args.vg);
+
+		nvgBeginPath(args.vg);
+		for (int x = 0; x < static_cast<int>(box.size.x); x++) {
+			const WaveformOverview::Bucket bucket = overview.summarize(x * framesPerPixel, (x + 1) * framesPerPixel);
+			const float rms = clamp(std::sqrt(bucket.meanSquare) * scaleY, 0.0f, centerY);
+			nvgRect(args.vg, x, centerY - rms, 1.0f, std::max(2.0f * rms, 1.0f));
+		}
+		nvgFillColor(args.vg, rmsColor);
+		nvgFill(args.vg);
+
+		// Play head
+		const float playHeadX = clamp(module->getDisplayPosition(), 0.0f, 1.0f) * box.size.x;
+		nvgBeginPath(args.vg);
+		nvgMoveTo(args.vg, playHeadX, 0.0f);
+		nvgLineTo(args.vg, playHeadX, box.size.y);
+		nvgStrokeColor(args.vg, nvgRGBA(0xff, 0xff, 0xff, 0xff));
+		nvgStrokeWidth(args.vg, 1.0f);
+		nvgStroke(args.vg);
+	}
+};
+
+
+// Menu item for a module option. Changes are applied by the engine thread.
+static MenuItem *createOptionMenuItem(RadioMusic *module, std::string text, RadioMusic::Options option) {
+	return createBoolMenuItem(text, "",
+		[=]() { return module->getOption(option); },
+		[=](bool value) { module->setOption(option, value); });
+}
+
+
 struct RadioMusicWidget : ModuleWidget {
 	RadioMusicWidget(RadioMusic *module) {
 		setModule(module);
@@ -1190,6 +2335,11 @@ struct RadioMusicWidget : ModuleWidget {
 		addInput(createInput<PJ301MPort>(Vec(3, 318), module, RadioMusic::RESET_INPUT));
 		addOutput(createOutput<PJ301MPort>(Vec(32, 318), module, RadioMusic::OUT_OUTPUT));
 
+		RadioMusicWaveformDisplay *waveformDisplay = createWidget<RadioMusicWaveformDisplay>(Vec(4, 238));
+		waveformDisplay->box.size = Vec(52, 20);
+		waveformDisplay->module = module;
+		addChild(waveformDisplay);
+
 		addChild(createWidget<ScrewSilver>(Vec(14, 365)));
 	};
 
@@ -1236,12 +2386,66 @@ struct RadioMusicWidget : ModuleWidget {
 
 		menu->addChild(new MenuSeparator);
 
-		menu->addChild(createBoolPtrMenuItem("Stereo Output enabled", "", &module->stereoOutputMode));
-		menu->addChild(createBoolPtrMenuItem("Pitch Mode enabled", "", &module->pitchMode));
-		menu->addChild(createBoolPtrMenuItem("Looping enabled", "", &module->loopingEnabled));
-		menu->addChild(createBoolPtrMenuItem("Crossfade enabled", "", &module->crossfadeEnabled));
-		menu->addChild(createBoolPtrMenuItem("Files sorted", "", &module->sortFiles));
-		menu->addChild(createBoolPtrMenuItem("All files allowed", "", &module->allowAllFiles));
+		menu->addChild(createOptionMenuItem(module, "Stereo Output enabled", RadioMusic::STEREO_OUTPUT_OPTION));
+		menu->addChild(createOptionMenuItem(module, "Pitch Mode enabled", RadioMusic::PITCH_MODE_OPTION));
+		menu->addChild(createOptionMenuItem(module, "Looping enabled", RadioMusic::LOOPING_OPTION));
+		menu->addChild(createOptionMenuItem(module, "Crossfade enabled", RadioMusic::CROSSFADE_OPTION));
+		menu->addChild(createCrossfadeMenuItem(&module->crossfade));
+		menu->addChild(createOptionMenuItem(module, "Files sorted", RadioMusic::SORT_FILES_OPTION));
+		menu->addChild(createOptionMenuItem(module, "All files allowed", RadioMusic::ALLOW_ALL_FILES_OPTION));
+		menu->addChild(createBoolMenuItem("Compress samples in memory", "",
+			[=]() { return module->getOption(RadioMusic::COMPRESS_SAMPLES_OPTION); },
+			[=](bool compress) {
+				module->setOption(RadioMusic::COMPRESS_SAMPLES_OPTION, compress);
+				// Reload current bank with new setting.
+				if (module->getCurrentObjectPoolSize() > 0) {
+					module->reloadCurrentBank();
+				}
+			}));
+		menu->addChild(createSubmenuItem("Sample memory", "",
+			[=](Menu *menu) {
+				menu->addChild(createOptionMenuItem(module, "Use huge pages", RadioMusic::HUGE_PAGES_OPTION));
+				menu->addChild(createOptionMenuItem(module, "Lock in RAM", RadioMusic::LOCK_SAMPLE_MEMORY_OPTION));
+				menu->addChild(createMenuLabel("Takes effect when the next bank is loaded."));
+			}));
+		menu->addChild(createControlRateMenuItem(&module->controlRate));
+		menu->addChild(createAdaptiveQualityMenuItem(&module->adaptiveQuality));
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createSubmenuItem("Statistics", "",
+			[=](Menu *menu) {
+				const RadioMusicStats &stats = module->stats;
+				const char *unit = instrumentation::cycleCounterUnit();
+				menu->addChild(createMenuLabel(string::f("Files decoded: %llu (%llu failed)",
+					(unsigned long long)stats.filesDecoded.get(), (unsigned long long)stats.filesFailed.get())));
+				menu->addChild(createMenuLabel(string::f("Decoded: %.1f MB at %.1f MB/s, last bank in %.3f s",
+					stats.bytesDecoded.get() / 1e6, stats.decodeThroughput() / 1e6, stats.lastLoadNs.get() / 1e9)));
+				menu->addChild(createMenuLabel(string::f("Bank: %llu files, %.1f MB",
+					(unsigned long long)stats.poolFiles.get(), stats.poolMemory.get() / 1e6)));
+				menu->addChild(createMenuLabel(string::f("Bank swaps: %llu, latency %.2f ms (max %.2f ms)",
+					(unsigned long long)stats.poolSwaps.get(), stats.lastSwapLatencyNs.get() / 1e6, stats.maxSwapLatencyNs.get() / 1e6)));
+				menu->addChild(createMenuLabel(string::f("Underruns: %llu frames", (unsigned long long)stats.underruns.get())));
+				menu->addChild(createMenuLabel(string::f("Crossfades: %llu, fade outs: %llu",
+					(unsigned long long)stats.crossfades.get(), (unsigned long long)stats.fadeOuts.get())));
+				menu->addChild(createMenuLabel(string::f("Compressed blocks: %llu decoded in %.1f ms, %llu late",
+					(unsigned long long)stats.blocksDecoded.get(), stats.blockDecodeNs.get() / 1e6,
+					(unsigned long long)stats.cacheMisses.get())));
+				menu->addChild(createMenuLabel(string::f("process(): p50 %llu, p99 %llu, max %llu %s",
+					(unsigned long long)stats.processCycles.percentile(0.5), (unsigned long long)stats.processCycles.percentile(0.99),
+					(unsigned long long)stats.processCycles.max(), unit)));
+				menu->addChild(createMenuLabel(string::f("Render block: p50 %llu, p99 %llu, max %llu %s",
+					(unsigned long long)stats.renderCycles.percentile(0.5), (unsigned long long)stats.renderCycles.percentile(0.99),
+					(unsigned long long)stats.renderCycles.max(), unit)));
+				menu->addChild(createMenuLabel(string::f("Quality: %s, %.1f%% CPU, %llu level changes",
+					AdaptiveQuality::levelName(module->adaptiveQuality.getLevel()), 100.0f * module->adaptiveQuality.getLoad(),
+					(unsigned long long)module->adaptiveQuality.getChanges())));
+				menu->addChild(new MenuSeparator);
+				menu->addChild(createMenuItem("Write statistics file", "",
+					[=]() { module->writeStats(); }));
+				menu->addChild(createMenuItem("Reset statistics", "",
+					[=]() { module->stats.reset(); }));
+			}));
+		menu->addChild(createInputCaptureMenuItem(module, &module->inputCapture));
 	}
 };
 
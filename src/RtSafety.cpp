@@ -0,0 +1,195 @@
+#include "RtSafety.hpp"
+
+#if defined(RT_SAFETY_CHECK) && defined(__GLIBC__)
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define RT_SAFETY_MAX_FRAMES 32
+#define RT_SAFETY_MAX_SITES 1024 // Call sites reported with a stack trace
+
+// glibc allocator behind the interposed functions. Calling it directly
+// avoids dlsym(), which allocates itself.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+
+namespace {
+
+// Plain TLS: thread_local objects may allocate on first use.
+__thread const char *scopeName = nullptr;
+__thread bool reporting = false;
+
+std::atomic<uint64_t> violationCount(0);
+std::atomic<uint64_t> reportedSites[RT_SAFETY_MAX_SITES];
+
+// Next definition of an interposed lock function (libc or libpthread).
+template <typename Function>
+Function next(std::atomic<Function> &function, const char *name) {
+	Function f = function.load(std::memory_order_relaxed);
+	if (!f) {
+		f = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+		function.store(f, std::memory_order_relaxed);
+	}
+	return f;
+}
+
+typedef int (*MutexLock)(pthread_mutex_t*);
+typedef int (*RwLock)(pthread_rwlock_t*);
+std::atomic<MutexLock> nextMutexLock(nullptr);
+std::atomic<RwLock> nextRdLock(nullptr);
+std::atomic<RwLock> nextWrLock(nullptr);
+
+// True the first time a stack is seen.
+bool firstReport(void *const *frames, const int numFrames) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (int i = 0; i < numFrames; i++) {
+		hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 0x100000001b3ull;
+	}
+	hash |= 1; // 0 marks a free slot
+
+	for (int i = 0; i < RT_SAFETY_MAX_SITES; i++) {
+		std::atomic<uint64_t> &site = reportedSites[(hash + i) % RT_SAFETY_MAX_SITES];
+		uint64_t expected = 0;
+		if (site.compare_exchange_strong(expected, hash)) {
+			return true;
+		}
+		if (expected == hash) {
+			return false;
+		}
+	}
+	return false; // Table full, only count.
+}
+
+// Fast path of every interposed call: one TLS read.
+inline bool violation(const char *call, const size_t size) {
+	if (!scopeName || reporting) {
+		return false;
+	}
+	reporting = true; // Allocations while reporting are ours.
+	violationCount++;
+
+	void *frames[RT_SAFETY_MAX_FRAMES];
+	const int numFrames = backtrace(frames, RT_SAFETY_MAX_FRAMES);
+	if (firstReport(frames, numFrames)) {
+		fprintf(stderr, "RT safety: %s(%zu) in %s\n", call, size, scopeName);
+		// Skips this function and the interposed call.
+		backtrace_symbols_fd(frames + 2, numFrames - 2, STDERR_FILENO);
+		fputc('\n', stderr);
+	}
+
+	reporting = false;
+	return true;
+}
+
+struct Summary {
+	~Summary() {
+		if (violationCount > 0) {
+			fprintf(stderr, "RT safety: %llu violations\n", (unsigned long long)violationCount);
+		}
+	}
+} summary;
+
+} // namespace
+
+
+rtsafety::Scope::Scope(const char *name) :
+  previousName(scopeName)
+{
+	scopeName = name;
+}
+
+rtsafety::Scope::~Scope() {
+	scopeName = previousName;
+}
+
+uint64_t rtsafety::violations() {
+	return violationCount;
+}
+
+
+extern "C" {
+
+void *malloc(size_t size) {
+	violation("malloc", size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+	violation("calloc", count * size);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	violation("realloc", size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+	if (ptr) {
+		violation("free", 0);
+	}
+	__libc_free(ptr);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+	violation("posix_memalign", size);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	violation("aligned_alloc", size);
+	return __libc_memalign(alignment, size);
+}
+
+// Waiting on a condition variable needs a locked mutex, so it is caught here too.
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+	violation("pthread_mutex_lock", 0);
+	return next(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock) {
+	violation("pthread_rwlock_rdlock", 0);
+	return next(nextRdLock, "pthread_rwlock_rdlock")(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock) {
+	violation("pthread_rwlock_wrlock", 0);
+	return next(nextWrLock, "pthread_rwlock_wrlock")(lock);
+}
+
+} // extern "C"
+
+#elif defined(RT_SAFETY_CHECK)
+
+// Scopes are tracked, but nothing is interposed.
+static __thread const char *scopeName = nullptr;
+
+rtsafety::Scope::Scope(const char *name) :
+  previousName(scopeName)
+{
+	scopeName = name;
+}
+
+rtsafety::Scope::~Scope() {
+	scopeName = previousName;
+}
+
+uint64_t rtsafety::violations() {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Real-time safety check (debug builds, Linux/glibc only). Built with
+// RT_SAFETY_CHECK defined, malloc/free and pthread locking are interposed.
+// Every call made on a thread inside an RT_SAFE_SCOPE is reported with a
+// stack trace (once per call site) and counted. Interposition only works in
+// executables, so the check runs in the benchmark and replay drivers
+// (`make bench RT_SAFETY_CHECK=1`), not in Rack.
+//
+// Without RT_SAFETY_CHECK the macros compile to nothing.
+#ifdef RT_SAFETY_CHECK
+
+namespace rtsafety {
+
+// Marks the calling thread as real-time while in scope. Scopes nest.
+struct Scope {
+
+	explicit Scope(const char *name);
+	~Scope();
+
+private:
+
+	const char *previousName;
+
+};
+
+// Violations counted since the start of the program.
+uint64_t violations();
+
+} // namespace rtsafety
+
+#define RT_SAFE_SCOPE(name) rtsafety::Scope rtSafeScope(name)
+
+#else
+
+#define RT_SAFE_SCOPE(name)
+
+#endif
@@ -0,0 +1,145 @@
+#include "modular80.hpp"
+#include "SampleArena.hpp"
+
+#if defined ARCH_WIN
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define ARENA_CHUNK_SIZE (64ul << 20) // 64MB per chunk
+#define ARENA_ALIGNMENT 64ul
+#define ARENA_HUGE_PAGE_SIZE (2ul << 20)
+
+
+namespace {
+
+size_t pageSize() {
+#if defined ARCH_WIN
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#else
+	return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+size_t roundUp(const size_t value, const size_t multiple) {
+	return ((value + multiple - 1) / multiple) * multiple;
+}
+
+char *mapMemory(const size_t size, const bool hugePages) {
+#if defined ARCH_WIN
+	(void)hugePages; // Large pages need SeLockMemoryPrivilege, which Rack does not have.
+	return static_cast<char*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+	void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED) {
+		return nullptr;
+	}
+#if defined ARCH_LIN && defined MADV_HUGEPAGE
+	if (hugePages && madvise(data, size, MADV_HUGEPAGE) != 0) {
+		WARN("Huge pages not available for sample memory");
+	}
+#else
+	(void)hugePages;
+#endif
+	return static_cast<char*>(data);
+#endif
+}
+
+void unmapMemory(char *data, const size_t size) {
+#if defined ARCH_WIN
+	(void)size;
+	VirtualFree(data, 0, MEM_RELEASE);
+#else
+	munmap(data, size);
+#endif
+}
+
+bool lockMemory(char *data, const size_t size) {
+#if defined ARCH_WIN
+	return VirtualLock(data, size) != 0;
+#else
+	return mlock(data, size) == 0;
+#endif
+}
+
+// Touch every page, so it is backed by memory before the audio thread reads it.
+// Only allocated ranges are touched, so unused parts of a chunk cost nothing.
+void prefault(char *data, const size_t size) {
+	const size_t step = pageSize();
+	for (size_t offset = 0; offset < size; offset += step) {
+		volatile char *page = data + offset;
+		*page = 0;
+	}
+}
+
+} // namespace
+
+
+SampleArena::SampleArena(const Options &options) :
+  options(options),
+  mappedBytes(0)
+  {}
+
+SampleArena::~SampleArena() {
+	for (Chunk &chunk : chunks) {
+		unmapMemory(chunk.data, chunk.size);
+	}
+}
+
+float *SampleArena::allocate(const size_t count) {
+	const size_t bytes = roundUp(count * sizeof(float), ARENA_ALIGNMENT);
+
+	char *data = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (chunks.empty() || chunks.back().size - chunks.back().used < bytes) {
+			if (!addChunk(bytes)) {
+				return nullptr;
+			}
+		}
+
+		Chunk &chunk = chunks.back();
+		data = chunk.data + chunk.used;
+		chunk.used += bytes;
+	}
+
+	prefault(data, bytes);
+
+	if (options.lockMemory && !lockMemory(data, bytes)) {
+		WARN("Failed to lock %lu Bytes of sample memory", (unsigned long)bytes);
+	}
+
+	return reinterpret_cast<float*>(data);
+}
+
+size_t SampleArena::memoryUsage() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return mappedBytes;
+}
+
+bool SampleArena::addChunk(const size_t minSize) {
+	const size_t granularity = options.hugePages ? ARENA_HUGE_PAGE_SIZE : pageSize();
+	const size_t size = roundUp(std::max(minSize, (size_t)ARENA_CHUNK_SIZE), granularity);
+
+	char *data = mapMemory(size, options.hugePages);
+	if (!data) {
+		WARN("Failed to map %lu Bytes of sample memory", (unsigned long)size);
+		return false;
+	}
+
+	chunks.push_back({data, size, 0});
+	mappedBytes += size;
+
+	return true;
+}
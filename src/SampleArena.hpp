@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+
+// Bump allocator for the sample data of one bank.
+//
+// Memory is mapped from the OS in large chunks which are pre-faulted (and
+// optionally locked) by the loading thread, so the audio thread never takes a
+// page fault on freshly loaded audio. All chunks are released together when
+// the arena is destroyed.
+class SampleArena {
+
+public:
+
+struct Options {
+	bool hugePages = false;   // Ask for huge pages where supported
+	bool lockMemory = false;  // Lock pages in RAM where permitted
+};
+
+explicit SampleArena(const Options &options);
+~SampleArena();
+
+SampleArena(const SampleArena&) = delete;
+SampleArena &operator=(const SampleArena&) = delete;
+
+// Allocate `count` floats. Thread-safe. Returns nullptr if mapping fails.
+float *allocate(const size_t count);
+
+// Bytes mapped from the OS.
+size_t memoryUsage() const;
+
+private:
+
+struct Chunk {
+	char *data;
+	size_t size;
+	size_t used;
+};
+
+bool addChunk(const size_t minSize);
+
+Options options;
+std::vector<Chunk> chunks;
+size_t mappedBytes;
+mutable std::mutex mutex;
+
+};
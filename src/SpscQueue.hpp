@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+//
+// Consumed elements stay in their slot until the producer reuses it, so the
+// consumer can swap resources (e.g. strings) out of an element without
+// allocating or freeing memory itself.
+template <typename T, size_t S>
+class SpscQueue {
+
+static_assert(S > 0 && (S & (S - 1)) == 0, "Queue size must be a power of 2");
+
+public:
+
+// Producer: returns false if the queue is full.
+bool push(T &&value) {
+	const size_t write = writeIndex.load(std::memory_order_relaxed);
+	if (write - readIndex.load(std::memory_order_acquire) == S) {
+		return false;
+	}
+	slots[write & (S - 1)] = std::move(value);
+	writeIndex.store(write + 1, std::memory_order_release);
+	return true;
+}
+
+// Consumer: oldest element, or nullptr if the queue is empty.
+T *front() {
+	const size_t read = readIndex.load(std::memory_order_relaxed);
+	if (read == writeIndex.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	return &slots[read & (S - 1)];
+}
+
+// Consumer: release the element returned by front().
+void pop() {
+	readIndex.store(readIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+private:
+
+T slots[S];
+
+// Indices are written by different threads, keep them on separate cache lines.
+std::atomic<size_t> writeIndex{0};
+char padding[64];
+std::atomic<size_t> readIndex{0};
+
+};
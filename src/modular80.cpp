@@ -1,10 +1,14 @@
 #include "modular80.hpp"
+#include "Cpu.hpp"
 
 Plugin *pluginInstance;
 
 void init(Plugin *p) {
 	pluginInstance = p;
 
+	// Select the kernel variants for this CPU.
+	cpu::init();
+
 	p->addModel(modelLogistiker);
 	p->addModel(modelNosering);
 	p->addModel(modelRadioMusic);